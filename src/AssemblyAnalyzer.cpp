@@ -1,6 +1,7 @@
 #include "AssemblyAnalyzer.h"
 #include <Zydis/Zydis.h>
 #include <iostream>
+#include "ShardedCache.h"
 
 struct FunctionPointerContainerImpl {
     void* FunctionAddress;
@@ -77,6 +78,31 @@ void* DiscoverRealFunctionAddress(uint8_t* FunctionPtr, bool& bIsVirtualFunction
     return FunctionPtr;
 }
 
+struct AnalyzedFunctionInfo {
+    void* RealFunctionAddress;
+    bool bIsVirtualFunction;
+    uint32_t VirtualTableOffset;
+};
+
+//decoding is thread safe, so concurrent misses are analyzed in parallel and the first result is kept
+static ShardedCache<void*, AnalyzedFunctionInfo> AnalyzedFunctionCache;
+static CacheCounters AnalyzedFunctionCacheCounters;
+
+AnalyzedFunctionInfo AnalyzeFunctionCode(void* CodePointer) {
+    AnalyzedFunctionInfo FunctionInfo{nullptr, false, 0};
+    if (AnalyzedFunctionCache.Find(CodePointer, FunctionInfo)) {
+        AnalyzedFunctionCacheCounters.RecordHit();
+        return FunctionInfo;
+    }
+    AnalyzedFunctionCacheCounters.RecordMiss();
+    FunctionInfo.RealFunctionAddress = DiscoverRealFunctionAddress((uint8_t*) CodePointer, FunctionInfo.bIsVirtualFunction, FunctionInfo.VirtualTableOffset);
+    return AnalyzedFunctionCache.Insert(CodePointer, FunctionInfo);
+}
+
+const CacheCounters& GetMemberFunctionDigestCacheCounters() {
+    return AnalyzedFunctionCacheCounters;
+}
+
 MemberFunctionInfo DigestMemberFunctionPointer(void* FunctionPointerContainer, size_t ContainerSize) {
     auto* ptr = reinterpret_cast<FunctionPointerContainerImpl*>(FunctionPointerContainer);
     uint32_t ThisAdjustment;
@@ -94,10 +120,8 @@ MemberFunctionInfo DigestMemberFunctionPointer(void* FunctionPointerContainer, s
         std::cerr << "[WARN] Unsupported member function pointer size: " << ContainerSize << std::endl;
         return MemberFunctionInfo{nullptr};
     };
-    bool bIsVirtualFunction = false;
-    uint32_t VirtualTableOffset = 0;
-    void* RealFunctionAddress = DiscoverRealFunctionAddress((uint8_t*) CodePointer, bIsVirtualFunction, VirtualTableOffset);
-    return MemberFunctionInfo{RealFunctionAddress, ThisAdjustment, bIsVirtualFunction, VirtualTableOffset};
+    const AnalyzedFunctionInfo FunctionInfo = AnalyzeFunctionCode(CodePointer);
+    return MemberFunctionInfo{FunctionInfo.RealFunctionAddress, ThisAdjustment, FunctionInfo.bIsVirtualFunction, FunctionInfo.VirtualTableOffset};
 }
 
 /*HRESULT CoCreateDiaDataSource(HMODULE diaDllHandle, IDiaDataSource** data_source) {
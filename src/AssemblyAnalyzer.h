@@ -1,6 +1,7 @@
 #ifndef XINPUT1_3_ASSEMBLY_ANALYZER_H
 #define XINPUT1_3_ASSEMBLY_ANALYZER_H
 #include <cstdint>
+#include "CacheCounters.h"
 
 template<typename FunctionPtrType>
 struct PointerContainer {
@@ -16,6 +17,9 @@ struct MemberFunctionInfo {
     uint32_t VirtualTableOffset;
 };
 
+/** Analysis of the code behind the pointer is memoized by the code pointer, so it is disassembled only once */
 MemberFunctionInfo DigestMemberFunctionPointer(void* FunctionPointerContainer, size_t ContainerSize);
 
+const CacheCounters& GetMemberFunctionDigestCacheCounters();
+
 #endif //XINPUT1_3_ASSEMBLY_ANALYZER_H
@@ -0,0 +1,16 @@
+#ifndef XINPUT1_3_CACHECOUNTERS_H
+#define XINPUT1_3_CACHECOUNTERS_H
+
+#include <atomic>
+#include <cstdint>
+
+/** Hit and miss counters of the memoization cache, updated without locking */
+struct CacheCounters {
+    std::atomic<uint64_t> Hits{0};
+    std::atomic<uint64_t> Misses{0};
+
+    inline void RecordHit() { Hits.fetch_add(1, std::memory_order_relaxed); }
+    inline void RecordMiss() { Misses.fetch_add(1, std::memory_order_relaxed); }
+};
+
+#endif //XINPUT1_3_CACHECOUNTERS_H
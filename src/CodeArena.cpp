@@ -0,0 +1,133 @@
+#include "CodeArena.h"
+#include <windows.h>
+
+//address space reserved at once, generated code of the whole game session normally fits into one block
+#define CODE_ARENA_RESERVE_SIZE (16 * 1024 * 1024)
+//memory is committed in batches of this size as the arena grows
+#define CODE_ARENA_COMMIT_SIZE (64 * 1024)
+//same alignment compilers use for function entry points
+#define CODE_ARENA_FUNCTION_ALIGNMENT 16
+//maximum distance reachable by rel32 displacement, with some room left for the instruction itself
+#define CODE_ARENA_NEAR_DISTANCE 0x7FF00000ull
+
+static size_t AlignUp(size_t Value, size_t Alignment) {
+    return (Value + Alignment - 1) & ~(Alignment - 1);
+}
+
+static size_t AlignDown(size_t Value, size_t Alignment) {
+    return Value & ~(Alignment - 1);
+}
+
+CodeArena::CodeArena(const void* NearImageBase, size_t NearImageSize) : FunctionCount(0),
+    NearImageBase((uintptr_t) NearImageBase), NearImageSize(NearImageSize), FarBlockCount(0) {}
+
+CodeArena::~CodeArena() {
+    for (const Block& ArenaBlock : Blocks) {
+        VirtualFree(ArenaBlock.BaseAddress, 0, MEM_RELEASE);
+    }
+}
+
+uint8_t* CodeArena::ReserveInRange(uintptr_t RangeStart, uintptr_t RangeEnd, size_t Size) {
+    SYSTEM_INFO SystemInfo;
+    GetSystemInfo(&SystemInfo);
+    const size_t Granularity = SystemInfo.dwAllocationGranularity;
+    uintptr_t Address = AlignUp(RangeStart, Granularity);
+    MEMORY_BASIC_INFORMATION MemoryInfo;
+    while (Address + Size <= RangeEnd && VirtualQuery((LPCVOID) Address, &MemoryInfo, sizeof(MemoryInfo)) != 0) {
+        const uintptr_t RegionEnd = (uintptr_t) MemoryInfo.BaseAddress + MemoryInfo.RegionSize;
+        if (MemoryInfo.State == MEM_FREE && Address + Size <= RegionEnd) {
+            void* BaseAddress = VirtualAlloc((LPVOID) Address, Size, MEM_RESERVE, PAGE_NOACCESS);
+            if (BaseAddress != nullptr) {
+                return (uint8_t*) BaseAddress;
+            }
+        }
+        Address = AlignUp(RegionEnd, Granularity);
+    }
+    return nullptr;
+}
+
+bool CodeArena::ReserveBlock(size_t MinimumSize) {
+    const size_t ReservedSize = AlignUp(MinimumSize > CODE_ARENA_RESERVE_SIZE ? MinimumSize : CODE_ARENA_RESERVE_SIZE, CODE_ARENA_COMMIT_SIZE);
+    uint8_t* BaseAddress = nullptr;
+    if (NearImageSize != 0) {
+        //whole block should be reachable from the whole image: look right after the image first, then before it
+        const uintptr_t ImageEnd = NearImageBase + NearImageSize;
+        const uintptr_t UpperBound = NearImageBase + CODE_ARENA_NEAR_DISTANCE;
+        const uintptr_t LowerBound = ImageEnd > CODE_ARENA_NEAR_DISTANCE ? ImageEnd - CODE_ARENA_NEAR_DISTANCE : 0;
+        BaseAddress = ReserveInRange(ImageEnd, UpperBound, ReservedSize);
+        if (BaseAddress == nullptr) {
+            BaseAddress = ReserveInRange(LowerBound, AlignDown(NearImageBase, CODE_ARENA_COMMIT_SIZE), ReservedSize);
+        }
+    }
+    if (BaseAddress == nullptr) {
+        BaseAddress = (uint8_t*) VirtualAlloc(nullptr, ReservedSize, MEM_RESERVE, PAGE_NOACCESS);
+        if (BaseAddress == nullptr) {
+            return false;
+        }
+        if (NearImageSize != 0) {
+            FarBlockCount++;
+        }
+    }
+    Blocks.push_back(Block{BaseAddress, ReservedSize, 0, 0});
+    return true;
+}
+
+uint8_t* CodeArena::Allocate(size_t Size) {
+    if (Blocks.empty() || AlignUp(Blocks.back().UsedSize, CODE_ARENA_FUNCTION_ALIGNMENT) + Size > Blocks.back().ReservedSize) {
+        if (!ReserveBlock(Size)) {
+            return nullptr;
+        }
+    }
+    Block& CurrentBlock = Blocks.back();
+    const size_t Offset = AlignUp(CurrentBlock.UsedSize, CODE_ARENA_FUNCTION_ALIGNMENT);
+    if (Offset + Size > CurrentBlock.CommittedSize) {
+        //generated code is patched by asmjit in place and other functions of the block can run meanwhile,
+        //so pages stay writable and executable, the same way JIT runtime allocates them
+        const size_t CommitSize = AlignUp(Offset + Size - CurrentBlock.CommittedSize, CODE_ARENA_COMMIT_SIZE);
+        if (VirtualAlloc(CurrentBlock.BaseAddress + CurrentBlock.CommittedSize, CommitSize, MEM_COMMIT, PAGE_EXECUTE_READWRITE) == nullptr) {
+            return nullptr;
+        }
+        CurrentBlock.CommittedSize += CommitSize;
+    }
+    CurrentBlock.UsedSize = Offset + Size;
+    return CurrentBlock.BaseAddress + Offset;
+}
+
+void* CodeArena::AddCode(asmjit::CodeHolder& Code) {
+    //same steps as JitRuntime::add, except that memory comes from the arena
+    if (Code.flatten() != asmjit::kErrorOk || Code.resolveUnresolvedLinks() != asmjit::kErrorOk) {
+        return nullptr;
+    }
+    const size_t EstimatedCodeSize = Code.codeSize();
+    uint8_t* CodeAddress = Allocate(EstimatedCodeSize);
+    if (CodeAddress == nullptr) {
+        return nullptr;
+    }
+    //relocation can only shrink the code by dropping unused address table entries
+    if (Code.relocateToBase((uint64_t) CodeAddress) != asmjit::kErrorOk ||
+        Code.copyFlattenedData(CodeAddress, EstimatedCodeSize, asmjit::CodeHolder::kCopyWithPadding) != asmjit::kErrorOk) {
+        return nullptr;
+    }
+    const size_t CodeSize = Code.codeSize();
+    //give unused tail back, it is always at the end of the current block
+    Blocks.back().UsedSize -= EstimatedCodeSize - CodeSize;
+    FlushInstructionCache(GetCurrentProcess(), CodeAddress, CodeSize);
+    FunctionCount++;
+    return CodeAddress;
+}
+
+size_t CodeArena::GetUsedSize() const {
+    size_t UsedSize = 0;
+    for (const Block& ArenaBlock : Blocks) {
+        UsedSize += ArenaBlock.UsedSize;
+    }
+    return UsedSize;
+}
+
+size_t CodeArena::GetCommittedSize() const {
+    size_t CommittedSize = 0;
+    for (const Block& ArenaBlock : Blocks) {
+        CommittedSize += ArenaBlock.CommittedSize;
+    }
+    return CommittedSize;
+}
@@ -0,0 +1,60 @@
+#ifndef XINPUT1_3_CODEARENA_H
+#define XINPUT1_3_CODEARENA_H
+
+#define WIN32_LEAN_AND_MEAN
+#define ASMJIT_STATIC 1
+#include "asmjit.h"
+#include <cstdint>
+#include <vector>
+
+/**
+ * Executable memory for the generated code, allocated as a bump pointer over large reserved blocks
+ * Memory is committed in batches as the arena grows, so generated functions are packed next to each other
+ * in the order they were generated, instead of each one taking a separate allocation of the JIT runtime
+ * Code is never freed, since generated functions stay referenced by the game and modules until the process exits
+ * Blocks are reserved within 2GB of the game image when possible, so generated code calls game functions
+ * with direct rel32 calls instead of going through the address table
+ */
+class CodeArena {
+private:
+    struct Block {
+        uint8_t* BaseAddress;
+        size_t ReservedSize;
+        size_t CommittedSize;
+        size_t UsedSize;
+    };
+    std::vector<Block> Blocks;
+    size_t FunctionCount;
+    uintptr_t NearImageBase;
+    size_t NearImageSize;
+    uint32_t FarBlockCount;
+public:
+    /**
+     * @param NearImageBase base of the image generated code should be placed close to
+     * @param NearImageSize size of that image in memory, or zero to place code anywhere
+     */
+    CodeArena(const void* NearImageBase, size_t NearImageSize);
+    ~CodeArena();
+
+    CodeArena(const CodeArena&) = delete;
+    CodeArena& operator=(const CodeArena&) = delete;
+
+    /** Relocates finalized code into the arena, @return address of the code or nullptr if memory can't be allocated */
+    void* AddCode(asmjit::CodeHolder& Code);
+
+    inline size_t GetFunctionCount() const { return FunctionCount; }
+    /** Bytes occupied by the generated code, including alignment padding */
+    size_t GetUsedSize() const;
+    /** Bytes of executable memory committed for the arena */
+    size_t GetCommittedSize() const;
+    /** Amount of blocks which couldn't be reserved within rel32 range of the image */
+    inline uint32_t GetFarBlockCount() const { return FarBlockCount; }
+private:
+    /** Allocates memory at the end of the current block, reserving new block if it doesn't fit */
+    uint8_t* Allocate(size_t Size);
+    bool ReserveBlock(size_t MinimumSize);
+    /** Reserves memory in the first free region fitting inside of the given address range */
+    static uint8_t* ReserveInRange(uintptr_t RangeStart, uintptr_t RangeEnd, size_t Size);
+};
+
+#endif //XINPUT1_3_CODEARENA_H
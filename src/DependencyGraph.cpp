@@ -0,0 +1,98 @@
+#include "DependencyGraph.h"
+#include <functional>
+#include <queue>
+
+bool ComputeDependencyLevels(const std::vector<std::vector<size_t>>& Dependencies, std::vector<std::vector<size_t>>& OutLevels) {
+    const size_t NodeCount = Dependencies.size();
+    std::vector<size_t> PendingDependencyCount(NodeCount, 0);
+    std::vector<std::vector<size_t>> Dependents(NodeCount);
+    for (size_t Node = 0; Node < NodeCount; Node++) {
+        for (size_t Dependency : Dependencies[Node]) {
+            if (Dependency != Node && Dependency < NodeCount) {
+                PendingDependencyCount[Node]++;
+                Dependents[Dependency].push_back(Node);
+            }
+        }
+    }
+    OutLevels.clear();
+    std::vector<bool> bNodeScheduled(NodeCount, false);
+    size_t ScheduledNodeCount = 0;
+    std::vector<size_t> CurrentLevel;
+    for (size_t Node = 0; Node < NodeCount; Node++) {
+        if (PendingDependencyCount[Node] == 0) {
+            CurrentLevel.push_back(Node);
+        }
+    }
+    while (!CurrentLevel.empty()) {
+        std::vector<bool> bReadyForNextLevel(NodeCount, false);
+        for (size_t Node : CurrentLevel) {
+            bNodeScheduled[Node] = true;
+            for (size_t Dependent : Dependents[Node]) {
+                if (--PendingDependencyCount[Dependent] == 0) {
+                    bReadyForNextLevel[Dependent] = true;
+                }
+            }
+        }
+        ScheduledNodeCount += CurrentLevel.size();
+        OutLevels.push_back(std::move(CurrentLevel));
+        CurrentLevel.clear();
+        //iterate in node order instead of the dependents order to keep levels deterministic
+        for (size_t Node = 0; Node < NodeCount; Node++) {
+            if (bReadyForNextLevel[Node]) {
+                CurrentLevel.push_back(Node);
+            }
+        }
+    }
+    if (ScheduledNodeCount == NodeCount) {
+        return true;
+    }
+    for (size_t Node = 0; Node < NodeCount; Node++) {
+        if (!bNodeScheduled[Node]) {
+            OutLevels.push_back({Node});
+        }
+    }
+    return false;
+}
+
+bool ComputeDependencyOrder(const std::vector<std::vector<size_t>>& Dependencies, std::vector<size_t>& OutOrder) {
+    const size_t NodeCount = Dependencies.size();
+    std::vector<size_t> PendingDependencyCount(NodeCount, 0);
+    std::vector<std::vector<size_t>> Dependents(NodeCount);
+    for (size_t Node = 0; Node < NodeCount; Node++) {
+        for (size_t Dependency : Dependencies[Node]) {
+            if (Dependency != Node && Dependency < NodeCount) {
+                PendingDependencyCount[Node]++;
+                Dependents[Dependency].push_back(Node);
+            }
+        }
+    }
+    OutOrder.clear();
+    std::vector<bool> bNodeScheduled(NodeCount, false);
+    //min-heap gives lexicographically smallest order among the valid ones
+    std::priority_queue<size_t, std::vector<size_t>, std::greater<>> ReadyNodes;
+    for (size_t Node = 0; Node < NodeCount; Node++) {
+        if (PendingDependencyCount[Node] == 0) {
+            ReadyNodes.push(Node);
+        }
+    }
+    while (!ReadyNodes.empty()) {
+        const size_t Node = ReadyNodes.top();
+        ReadyNodes.pop();
+        bNodeScheduled[Node] = true;
+        OutOrder.push_back(Node);
+        for (size_t Dependent : Dependents[Node]) {
+            if (--PendingDependencyCount[Dependent] == 0) {
+                ReadyNodes.push(Dependent);
+            }
+        }
+    }
+    if (OutOrder.size() == NodeCount) {
+        return true;
+    }
+    for (size_t Node = 0; Node < NodeCount; Node++) {
+        if (!bNodeScheduled[Node]) {
+            OutOrder.push_back(Node);
+        }
+    }
+    return false;
+}
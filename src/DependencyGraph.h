@@ -0,0 +1,25 @@
+#ifndef XINPUT1_3_DEPENDENCYGRAPH_H
+#define XINPUT1_3_DEPENDENCYGRAPH_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Splits nodes of the dependency graph into levels, where nodes of each level only depend on nodes of the previous levels,
+ * so nodes inside of the same level can be processed concurrently. Nodes keep their original relative order inside of the level
+ * Nodes participating in dependency cycles (and nodes depending on them) are placed one per level at the end, in their original order
+ * @param Dependencies indices of nodes each node depends on. Self references and out of range indices are ignored
+ * @return false if dependency cycle was found
+ */
+bool ComputeDependencyLevels(const std::vector<std::vector<size_t>>& Dependencies, std::vector<std::vector<size_t>>& OutLevels);
+
+/**
+ * Orders nodes of the dependency graph so each node comes after the nodes it depends on, picking the smallest
+ * ready node index at every step, so nodes without dependencies keep their original order
+ * Nodes participating in dependency cycles (and nodes depending on them) are placed at the end, in their original order
+ * @param Dependencies indices of nodes each node depends on. Self references and out of range indices are ignored
+ * @return false if dependency cycle was found
+ */
+bool ComputeDependencyOrder(const std::vector<std::vector<size_t>>& Dependencies, std::vector<size_t>& OutOrder);
+
+#endif //XINPUT1_3_DEPENDENCYGRAPH_H
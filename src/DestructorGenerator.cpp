@@ -1,8 +1,11 @@
 #include "DestructorGenerator.h"
 #include <iostream>
 #include <functional>
+#include <cstdint>
 #include <comdef.h>
 #include "logging.h"
+#include "SymbolResolver.h"
+#include "PeImage.h"
 using namespace asmjit::x86;
 
 #define CHECK_FAILED(hr, message) \
@@ -18,6 +21,16 @@ using namespace asmjit::x86;
 #define CALL_GET(Type, Name, Call, ...) Type Name; CHECK(Call(__VA_ARGS__, &Name));
 #define DUMP_GENERATED_CODE 1
 
+static size_t GetLoadedImageSize(LPVOID ImageBase) {
+    PeImage Image;
+    return Image.OpenLoadedImage(ImageBase) ? Image.GetSizeOfImage() : 0;
+}
+
+DestructorGenerator::DestructorGenerator(LPVOID gameDllBase, SymbolResolver* Resolver) :
+    Resolver(Resolver),
+    dllBaseAddress(gameDllBase),
+    Arena(gameDllBase, GetLoadedImageSize(gameDllBase)) {}
+
 CComPtr<IDiaSymbol> FindFirstSymbol(const CComPtr<IDiaEnumSymbols>& EnumSymbols) {
     CComPtr<IDiaSymbol> FirstSymbol;
     LONG SymbolCount = 0L;
@@ -66,44 +79,81 @@ bool CanGenerateDestructorFor(const CComPtr<IDiaSymbol>& Symbol) {
     return SymbolTag == SymTagUDT;
 }
 
-/**
- * Computes stack space required to generate destructor for given variable
- */
-uint64_t ComputeLocalVariableStackSpace(const CComPtr<IDiaSymbol>& Symbol) {
+bool IsArrayType(const CComPtr<IDiaSymbol>& Symbol) {
+    GET(DWORD, SymbolTag, Symbol->get_symTag);
+    return SymbolTag == SymTagArrayType;
+}
+
+bool DestructorGenerator::IsTriviallyDestructible(const CComPtr<IDiaSymbol>& Symbol) {
     GET(DWORD, SymbolTag, Symbol->get_symTag);
     if (SymbolTag == SymTagArrayType) {
         GET(CComPtr<IDiaSymbol>, ElementType, Symbol->get_type);
-        return ComputeLocalVariableStackSpace(ElementType) + 16;
+        return IsTriviallyDestructible(ElementType);
     }
-    return 0;
+    if (SymbolTag != SymTagUDT) {
+        return true;
+    }
+    GET(BSTR, ClassName, Symbol->get_name);
+    std::wstring ClassNameString(ClassName);
+    SysFreeString(ClassName);
+    const auto iterator = TriviallyDestructibleTypesMap.find(ClassNameString);
+    if (iterator != TriviallyDestructibleTypesMap.end()) {
+        return iterator->second;
+    }
+    //types can't contain themselves by value, so recursion always terminates
+    bool bTriviallyDestructible = !FindFirstDestructorSymbol(Symbol);
+    if (bTriviallyDestructible) {
+        CALL_GET(CComPtr<IDiaEnumSymbols>, ClassVariables, Symbol->findChildren, SymTagData, nullptr, nsNone);
+        ForEachSymbol(ClassVariables, [&](const CComPtr<IDiaSymbol>& MemberVar) {
+            GET(DWORD, DataKind, MemberVar->get_dataKind);
+            if (bTriviallyDestructible && DataKind == DataIsMember) {
+                GET(CComPtr<IDiaSymbol>, VariableType, MemberVar->get_type);
+                bTriviallyDestructible = IsTriviallyDestructible(VariableType);
+            }
+        });
+    }
+    if (bTriviallyDestructible) {
+        CALL_GET(CComPtr<IDiaEnumSymbols>, ParentBaseClasses, Symbol->findChildren, SymTagBaseClass, nullptr, nsNone);
+        ForEachSymbol(ParentBaseClasses, [&](const CComPtr<IDiaSymbol>& BaseClass) {
+            GET(CComPtr<IDiaSymbol>, BaseClassUDT, BaseClass->get_type);
+            if (bTriviallyDestructible && BaseClassUDT) {
+                bTriviallyDestructible = IsTriviallyDestructible(BaseClassUDT);
+            }
+        });
+    }
+    TriviallyDestructibleTypesMap.insert({ClassNameString, bTriviallyDestructible});
+    return bTriviallyDestructible;
+}
+
+bool DestructorGenerator::NeedsDestructorCall(const CComPtr<IDiaSymbol>& Symbol) {
+    return CanGenerateDestructorFor(Symbol) && !IsTriviallyDestructible(Symbol);
 }
 
-void DestructorGenerator::GenerateDestructorCall(const CComPtr<IDiaSymbol>& Symbol, asmjit::x86::Builder& a, uint64_t StackOffset) {
+void DestructorGenerator::GenerateDestructorCall(const CComPtr<IDiaSymbol>& Symbol, asmjit::x86::Builder& a) {
     GET(DWORD, SymbolTag, Symbol->get_symTag);
     if (SymbolTag == SymTagArrayType) {
-        GET(DWORD, ElementCount, Symbol->get_count);
+        //Multidimensional arrays are laid out contiguously, so they are destroyed as one flat array of the innermost element type
         GET(ULONGLONG, ArraySizeInBytes, Symbol->get_length);
-        GET(CComPtr<IDiaSymbol>, ElementType, Symbol->get_type);
-        GET(DWORD, ElementTypeSymTag, ElementType->get_symTag);
-        ULONGLONG ElementSize = ArraySizeInBytes / ElementCount;
-
-        //Initialize locations to store results
-        Mem LoopCounterLocation = qword_ptr(rsp, StackOffset);
-        Mem ThisPtrLocation = ptr(rsp, StackOffset + 8);
+        CComPtr<IDiaSymbol> ElementType = Symbol;
+        while (IsArrayType(ElementType)) {
+            GET(CComPtr<IDiaSymbol>, InnerElementType, ElementType->get_type);
+            ElementType = InnerElementType;
+        }
+        GET(ULONGLONG, ElementSize, ElementType->get_length);
+        if (ElementSize == 0 || ArraySizeInBytes < ElementSize) {
+            return;
+        }
 
-        //Set loop counter = ElementCounter, this = rcx;
-        a.mov(LoopCounterLocation, asmjit::imm(ElementCount));
-        a.mov(ThisPtrLocation, rcx);
+        //Elements are destroyed in reverse order, rbx points past the element being destroyed and rsi to the first one
+        //Both are callee-saved, so they survive element destructor calls. See GenerateDestructorFunction prolog
+        a.mov(rsi, rcx);
+        a.lea(rbx, ptr(rcx, (int32_t) ArraySizeInBytes));
         asmjit::Label LoopBeginLabel = a.newLabel();
         a.bind(LoopBeginLabel);
-        //Remove 1 from loop counter, set rcx = this + ElementSize * LoopCounter;
-        a.sub(LoopCounterLocation, 1);
-        a.mov(rcx, ThisPtrLocation);
-        a.mov(rax, LoopCounterLocation);
-        a.imul(rax, asmjit::imm(ElementSize));
-        a.add(rcx, rax);
-        GenerateDestructorCall(ElementType, a, StackOffset + 16);
-        a.cmp(LoopCounterLocation, 0);
+        a.sub(rbx, asmjit::imm(ElementSize));
+        a.mov(rcx, rbx);
+        GenerateDestructorCall(ElementType, a);
+        a.cmp(rbx, rsi);
         a.jne(LoopBeginLabel);
 
     } else if (SymbolTag == SymTagUDT) {
@@ -144,6 +194,7 @@ DestructorFunctionPtr DestructorGenerator::FindOrGenerateDestructorFunction(cons
 }
 
 DummyFunctionPtr DestructorGenerator::GenerateDummyFunction(const std::string& FunctionName, DummyFunctionCallHandler CallHandler) {
+    std::lock_guard Guard(Resolver->GetGenerationMutex());
     const auto iterator = GeneratedDummyFunctionsMap.find(FunctionName);
     if (iterator != GeneratedDummyFunctionsMap.end()) {
         return iterator->second;
@@ -154,27 +205,23 @@ DummyFunctionPtr DestructorGenerator::GenerateDummyFunction(const std::string& F
 }
 
 DummyFunctionPtr DestructorGenerator::DoGenerateDummyFunction(const std::string& FunctionName, DummyFunctionCallHandler CallHandler) {
-    size_t StringLength = FunctionName.length() + 1;
-    char* ConstantEntry = (char*) malloc(StringLength);
-    strcpy_s(ConstantEntry, StringLength, FunctionName.c_str());
-    ConstantPoolEntries.push_back(ConstantEntry);
-
     asmjit::CodeHolder code;
     code.init(runtime.codeInfo());
     asmjit::x86::Builder a(&code);
-    a.mov(asmjit::x86::rcx, asmjit::imm(ConstantEntry));
+    //function name is stored right after the code, so it is addressed relative to rip
+    asmjit::Label FunctionNameLabel = a.newLabel();
+    a.lea(asmjit::x86::rcx, asmjit::x86::ptr(FunctionNameLabel));
     a.call(asmjit::imm(CallHandler));
     a.ret();
+    a.bind(FunctionNameLabel);
+    a.embed(FunctionName.c_str(), static_cast<uint32_t>(FunctionName.length() + 1));
 
     a.finalize();
-    DummyFunctionPtr ResultFunction;
-    runtime.add(&ResultFunction, &code);
-    return ResultFunction;
+    return (DummyFunctionPtr) Arena.AddCode(code);
 }
 
-
-
 OpaqueFunctionPtr DestructorGenerator::GenerateConstructorPatchEntry(ConstructorCallbackEntry* CallBackEntry) {
+    std::lock_guard Guard(Resolver->GetGenerationMutex());
     asmjit::CodeHolder code;
     code.init(runtime.codeInfo());
     asmjit::x86::Builder a(&code);
@@ -200,36 +247,155 @@ OpaqueFunctionPtr DestructorGenerator::GenerateConstructorPatchEntry(Constructor
     a.ret();
 
     a.finalize();
-    OpaqueFunctionPtr ResultFunction;
-    runtime.add(&ResultFunction, &code);
-    return ResultFunction;
+    return (OpaqueFunctionPtr) Arena.AddCode(code);
+}
+
+OpaqueFunctionPtr DestructorGenerator::GenerateSpecializedConstructorPatchEntry(ConstructorCallbackEntry* CallBackEntry, const std::vector<PrecomputedVirtualTable>& VirtualTables) {
+    std::lock_guard Guard(Resolver->GetGenerationMutex());
+    asmjit::CodeHolder code;
+    code.init(runtime.codeInfo());
+    asmjit::x86::Builder a(&code);
+    asmjit::Label FallbackLabel = a.newLabel();
+    asmjit::Label ReturnLabel = a.newLabel();
+
+    //Move rcx (this) to home location, make fixed stack allocation
+    a.mov(qword_ptr(rsp, 8), rcx);
+    a.sub(rsp, 40);
+    //Call original function directly
+    a.call(asmjit::imm(CallBackEntry->TrampolineFunctionAddress));
+    a.mov(rcx, qword_ptr(rsp, 48));
+
+    //Check that constructor has installed expected tables first, so they are either all replaced or none of them is
+    for (const PrecomputedVirtualTable& VirtualTable : VirtualTables) {
+        a.mov(rax, asmjit::imm(VirtualTable.OriginalTable));
+        a.cmp(qword_ptr(rcx, VirtualTable.VirtualTableOriginOffset), rax);
+        a.jne(FallbackLabel);
+    }
+    for (const PrecomputedVirtualTable& VirtualTable : VirtualTables) {
+        a.mov(rax, asmjit::imm(VirtualTable.PatchedTable));
+        a.mov(qword_ptr(rcx, VirtualTable.VirtualTableOriginOffset), rax);
+    }
+
+    //Constructors return this, remove fixed allocation & ret
+    a.bind(ReturnLabel);
+    a.mov(rax, qword_ptr(rsp, 48));
+    a.add(rsp, 40);
+    a.ret();
+
+    //Some other table was installed, let the processor handle it with this already in rcx
+    a.bind(FallbackLabel);
+    a.mov(rdx, asmjit::imm(CallBackEntry->UserData));
+    a.call(asmjit::imm(CallBackEntry->CallProcessor));
+    a.jmp(ReturnLabel);
+
+    a.finalize();
+    return (OpaqueFunctionPtr) Arena.AddCode(code);
+}
+
+bool DestructorGenerator::RedirectGeneratedFunction(OpaqueFunctionPtr Function, OpaqueFunctionPtr Target, uint64_t& OutOriginalPrologue) {
+    auto* FunctionStart = (uint8_t*) Function;
+    const int64_t Displacement = (int64_t) ((uint8_t*) Target - (FunctionStart + 5));
+    if (Displacement < INT32_MIN || Displacement > INT32_MAX) {
+        return false;
+    }
+    //Generated functions are 16 bytes aligned, so first 8 bytes can be replaced with a single atomic store
+    const uint64_t OriginalPrologue = *(volatile uint64_t*) FunctionStart;
+    uint64_t JumpPrologue = OriginalPrologue;
+    auto* JumpBytes = (uint8_t*) &JumpPrologue;
+    const int32_t JumpDisplacement = (int32_t) Displacement;
+    JumpBytes[0] = 0xE9;
+    memcpy(JumpBytes + 1, &JumpDisplacement, sizeof(JumpDisplacement));
+    InterlockedExchange64((volatile LONG64*) FunctionStart, (LONG64) JumpPrologue);
+    FlushInstructionCache(GetCurrentProcess(), FunctionStart, sizeof(JumpPrologue));
+    OutOriginalPrologue = OriginalPrologue;
+    return true;
 }
 
-uint64_t ComputeStackSpaceRequired(IDiaEnumSymbols* ClassVariables) {
-    uint64_t StackSpaceRequired = 32;
-    ForEachSymbol(ClassVariables, [&StackSpaceRequired](const CComPtr<IDiaSymbol>& MemberVar) {
+void DestructorGenerator::RestoreGeneratedFunction(OpaqueFunctionPtr Function, uint64_t OriginalPrologue) {
+    InterlockedExchange64((volatile LONG64*) Function, (LONG64) OriginalPrologue);
+    FlushInstructionCache(GetCurrentProcess(), (LPCVOID) Function, sizeof(OriginalPrologue));
+}
+
+OpaqueFunctionPtr DestructorGenerator::GenerateResolveOnCallStub(void* Context, ResolveOnCallFunctionPtr ResolveFunction) {
+    std::lock_guard Guard(Resolver->GetGenerationMutex());
+    asmjit::CodeHolder code;
+    code.init(runtime.codeInfo());
+    asmjit::x86::Builder a(&code);
+
+    //Shadow space, 4 integer and 4 vector argument registers, keeping stack 16 byte aligned
+    a.sub(asmjit::x86::rsp, 0x88);
+    a.mov(asmjit::x86::qword_ptr(asmjit::x86::rsp, 0x20), asmjit::x86::rcx);
+    a.mov(asmjit::x86::qword_ptr(asmjit::x86::rsp, 0x28), asmjit::x86::rdx);
+    a.mov(asmjit::x86::qword_ptr(asmjit::x86::rsp, 0x30), asmjit::x86::r8);
+    a.mov(asmjit::x86::qword_ptr(asmjit::x86::rsp, 0x38), asmjit::x86::r9);
+    a.movaps(asmjit::x86::xmmword_ptr(asmjit::x86::rsp, 0x40), asmjit::x86::xmm0);
+    a.movaps(asmjit::x86::xmmword_ptr(asmjit::x86::rsp, 0x50), asmjit::x86::xmm1);
+    a.movaps(asmjit::x86::xmmword_ptr(asmjit::x86::rsp, 0x60), asmjit::x86::xmm2);
+    a.movaps(asmjit::x86::xmmword_ptr(asmjit::x86::rsp, 0x70), asmjit::x86::xmm3);
+
+    //Resolve function address, it will be returned in rax
+    a.mov(asmjit::x86::rcx, asmjit::imm(Context));
+    a.mov(asmjit::x86::rax, asmjit::imm(ResolveFunction));
+    a.call(asmjit::x86::rax);
+
+    //Restore arguments and jump to the resolved function as if it was called directly
+    a.mov(asmjit::x86::rcx, asmjit::x86::qword_ptr(asmjit::x86::rsp, 0x20));
+    a.mov(asmjit::x86::rdx, asmjit::x86::qword_ptr(asmjit::x86::rsp, 0x28));
+    a.mov(asmjit::x86::r8, asmjit::x86::qword_ptr(asmjit::x86::rsp, 0x30));
+    a.mov(asmjit::x86::r9, asmjit::x86::qword_ptr(asmjit::x86::rsp, 0x38));
+    a.movaps(asmjit::x86::xmm0, asmjit::x86::xmmword_ptr(asmjit::x86::rsp, 0x40));
+    a.movaps(asmjit::x86::xmm1, asmjit::x86::xmmword_ptr(asmjit::x86::rsp, 0x50));
+    a.movaps(asmjit::x86::xmm2, asmjit::x86::xmmword_ptr(asmjit::x86::rsp, 0x60));
+    a.movaps(asmjit::x86::xmm3, asmjit::x86::xmmword_ptr(asmjit::x86::rsp, 0x70));
+    a.add(asmjit::x86::rsp, 0x88);
+    a.jmp(asmjit::x86::rax);
+
+    a.finalize();
+    return (OpaqueFunctionPtr) Arena.AddCode(code);
+}
+
+bool DestructorGenerator::HasArrayMembersToDestroy(IDiaEnumSymbols* ClassVariables) {
+    bool bHasArrayMembers = false;
+    ForEachSymbol(ClassVariables, [&](const CComPtr<IDiaSymbol>& MemberVar) {
         GET(DWORD, DataKind, MemberVar->get_dataKind);
         if (DataKind == DataIsMember) {
             GET(CComPtr<IDiaSymbol>, VariableType, MemberVar->get_type);
-            if (CanGenerateDestructorFor(VariableType)) {
-                StackSpaceRequired += ComputeLocalVariableStackSpace(VariableType);
+            if (IsArrayType(VariableType) && NeedsDestructorCall(VariableType)) {
+                bHasArrayMembers = true;
             }
         }
     });
-    return StackSpaceRequired;
+    return bHasArrayMembers;
 }
 
 DestructorFunctionPtr DestructorGenerator::GenerateDestructorFunction(const CComPtr<IDiaSymbol>& ClassSymbol) {
+    if (IsTriviallyDestructible(ClassSymbol)) {
+        //nothing to destroy, so all such types share a single function which just returns
+        if (TrivialDestructorFunction == nullptr) {
+            asmjit::CodeHolder code;
+            code.init(runtime.codeInfo());
+            asmjit::x86::Builder a(&code);
+            a.ret();
+            a.finalize();
+            TrivialDestructorFunction = (DestructorFunctionPtr) Arena.AddCode(code);
+        }
+        return TrivialDestructorFunction;
+    }
     CALL_GET(CComPtr<IDiaEnumSymbols>, ClassVariables, ClassSymbol->findChildren, SymTagData, nullptr, nsNone);
     CALL_GET(CComPtr<IDiaEnumSymbols>, ParentBaseClasses, ClassSymbol->findChildren, SymTagBaseClass, nullptr, nsNone);
     asmjit::CodeHolder code;
     code.init(runtime.codeInfo());
     asmjit::x86::Builder a(&code);
-    //function prolog
+    //function prolog, array loop registers are saved into the home space of the caller along with this
+    const bool bSaveLoopRegisters = HasArrayMembersToDestroy(ClassVariables);
     a.mov(ptr(rsp, 8), rcx);
-    //ComputeStackSpaceRequired will always return multiple of 16, but x64 calling convention requires
-    //stack to be 16 bytes-aligned, but `call` will push return address on stack (8 bytes), so we need extra 8 bytes to keep alignment
-    uint64_t StackSpaceRequired = ComputeStackSpaceRequired(ClassVariables) + 8;
+    if (bSaveLoopRegisters) {
+        a.mov(ptr(rsp, 16), rbx);
+        a.mov(ptr(rsp, 24), rsi);
+    }
+    //32 bytes of home space for the calls, x64 calling convention requires stack to be 16 bytes-aligned,
+    //but `call` will push return address on stack (8 bytes), so we need extra 8 bytes to keep alignment
+    const uint64_t StackSpaceRequired = 32 + 8;
     a.sub(rsp, StackSpaceRequired);
 
     //Call field destructors now
@@ -237,13 +403,12 @@ DestructorFunctionPtr DestructorGenerator::GenerateDestructorFunction(const CCom
         GET(DWORD, DataKind, MemberVar->get_dataKind);
         if (DataKind == DataIsMember) {
             GET(CComPtr<IDiaSymbol>, VariableType, MemberVar->get_type);
-            if (CanGenerateDestructorFor(VariableType)) {
+            if (NeedsDestructorCall(VariableType)) {
                 GET(LONG, FieldOffset, MemberVar->get_offset);
                 //Move this ptr to rcx, add required offset
                 a.mov(rcx, ptr(rsp, StackSpaceRequired + 8));
                 a.add(rcx, asmjit::imm(FieldOffset));
-                //rsp now points to the end of stack reservation (lowest point, but we reserve 32 bytes for function calls)
-                GenerateDestructorCall(VariableType, a, 32);
+                GenerateDestructorCall(VariableType, a);
             }
         }
     });
@@ -252,17 +417,20 @@ DestructorFunctionPtr DestructorGenerator::GenerateDestructorFunction(const CCom
     ForEachSymbol(ParentBaseClasses, [&](const CComPtr<IDiaSymbol>& BaseClass) {
         GET(CComPtr<IDiaSymbol>, BaseClassUDT, BaseClass->get_type);
         GET(LONG, ClassOffset, BaseClass->get_offset);
-        if (BaseClassUDT && CanGenerateDestructorFor(BaseClassUDT)) {
+        if (BaseClassUDT && NeedsDestructorCall(BaseClassUDT)) {
             //Move this ptr to rcx, add required offset
             a.mov(rcx, ptr(rsp, StackSpaceRequired + 8));
             a.add(rcx, asmjit::imm(ClassOffset));
-            //rsp now points to the end of stack reservation (lowest point, but we reserve 32 bytes for function calls)
-            GenerateDestructorCall(BaseClassUDT, a, 32);
+            GenerateDestructorCall(BaseClassUDT, a);
         }
     });
 
     //function epilogue
     a.add(rsp, StackSpaceRequired);
+    if (bSaveLoopRegisters) {
+        a.mov(rbx, ptr(rsp, 16));
+        a.mov(rsi, ptr(rsp, 24));
+    }
     a.ret();
 #if DUMP_GENERATED_CODE
     Logging::logFile << "-------GENERATED DESTRUCTOR CODE BEGIN-------" << std::endl;
@@ -272,14 +440,14 @@ DestructorFunctionPtr DestructorGenerator::GenerateDestructorFunction(const CCom
     Logging::logFile << "--------GENERATED DESTRUCTOR CODE END--------" << std::endl;
 #endif
     a.finalize();
-    DestructorFunctionPtr ResultFunction;
-    runtime.add(&ResultFunction, &code);
-    return ResultFunction;
+    return (DestructorFunctionPtr) Arena.AddCode(code);
 }
 
 DestructorFunctionPtr DestructorGenerator::GenerateDestructor(const std::string& ClassName) {
     USES_CONVERSION;
-    CALL_GET(CComPtr<IDiaEnumSymbols>, FoundSymbols, globalSymbol->findChildren, SymTagUDT, A2COLE(ClassName.c_str()), nsCaseInsensitive);
+    std::lock_guard Guard(Resolver->GetGenerationMutex());
+    CComPtr<IDiaSymbol> GlobalSymbol = Resolver->GetGlobalSymbol();
+    CALL_GET(CComPtr<IDiaEnumSymbols>, FoundSymbols, GlobalSymbol->findChildren, SymTagUDT, A2COLE(ClassName.c_str()), nsCaseInsensitive);
     CComPtr<IDiaSymbol> FirstUDTSymbol = FindFirstSymbol(FoundSymbols);
     if (!FirstUDTSymbol) {
         return nullptr;
@@ -287,8 +455,4 @@ DestructorFunctionPtr DestructorGenerator::GenerateDestructor(const std::string&
     return FindOrGenerateDestructorFunction(FirstUDTSymbol);
 }
 
-DestructorGenerator::~DestructorGenerator() {
-    for (char* ConstantEntry : ConstantPoolEntries) {
-        free(ConstantEntry);
-    }
-}
+DestructorGenerator::~DestructorGenerator() = default;
@@ -4,8 +4,10 @@
 #define WIN32_LEAN_AND_MEAN
 #define ASMJIT_STATIC 1
 #include "asmjit.h"
+#include "CodeArena.h"
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include <atlbase.h>
 #include <dia2.h>
 
@@ -14,6 +16,7 @@ typedef void (*DummyFunctionPtr)();
 typedef void (*DummyFunctionCallHandler)(const char* FunctionName);
 
 typedef void (*OpaqueFunctionPtr)();
+typedef void* (*ResolveOnCallFunctionPtr)(void* Context);
 
 //--- DO NOT CHANGE LAYOUT OF THIS STRUCT - ASM CODE USES IT DIRECTLY ---
 struct ConstructorCallbackEntry {
@@ -25,32 +28,76 @@ struct ConstructorCallbackEntry {
     void* UserData;
 };
 
+/** Virtual table pointer installed by the specialized constructor patch entry */
+struct PrecomputedVirtualTable {
+    uint32_t VirtualTableOriginOffset;
+    void* OriginalTable;
+    void* PatchedTable;
+};
+
+/**
+ * Generates code in runtime. All generation is serialized by the generation lock of the SymbolResolver,
+ * since it shares the DIA session with it, so the generator can be used from any thread
+ */
 class DestructorGenerator {
 private:
-    CComPtr<IDiaSymbol> globalSymbol;
+    //used to lazily retrieve DIA global scope for type queries
+    class SymbolResolver* Resolver;
     LPVOID dllBaseAddress;
     std::unordered_map<std::wstring, DestructorFunctionPtr> GeneratedDestructorsMap;
     std::unordered_map<std::string, DummyFunctionPtr> GeneratedDummyFunctionsMap;
+    //whenever UDT has nothing to destroy in its whole member and base class tree, by class name
+    std::unordered_map<std::wstring, bool> TriviallyDestructibleTypesMap;
+    //shared by all generated destructors of trivially destructible types, it only returns
+    DestructorFunctionPtr TrivialDestructorFunction = nullptr;
+    //only provides code info of the host, code itself is placed into the arena
     asmjit::JitRuntime runtime;
-    std::vector<char*> ConstantPoolEntries;
+    CodeArena Arena;
 public:
-    DestructorGenerator(LPVOID gameDllBase, CComPtr<IDiaSymbol> globalSymbol) :
-        globalSymbol(std::move(globalSymbol)),
-        dllBaseAddress(gameDllBase) {}
+    DestructorGenerator(LPVOID gameDllBase, class SymbolResolver* Resolver);
     ~DestructorGenerator();
 
+    inline const CodeArena& GetCodeArena() const { return Arena; }
+
     DestructorFunctionPtr GenerateDestructor(const std::string& ClassName);
     DummyFunctionPtr GenerateDummyFunction(const std::string& FunctionName, DummyFunctionCallHandler CallHandler);
     /** Generates constructor patch entry. CallBackEntry should be valid as long as returned function is used */
     OpaqueFunctionPtr GenerateConstructorPatchEntry(ConstructorCallbackEntry* CallBackEntry);
+    /**
+     * Generates constructor patch entry with known virtual tables. It calls the trampoline set in CallBackEntry directly,
+     * and installs patched tables in place of the original ones without calling CallProcessor
+     * CallProcessor is only called if constructor has installed some other table
+     */
+    OpaqueFunctionPtr GenerateSpecializedConstructorPatchEntry(ConstructorCallbackEntry* CallBackEntry, const std::vector<PrecomputedVirtualTable>& VirtualTables);
+    /**
+     * Atomically overwrites beginning of the generated function with jump to another generated function
+     * @param OutOriginalPrologue receives overwritten bytes, used to restore the function
+     * @return false if functions are too far away from each other
+     */
+    bool RedirectGeneratedFunction(OpaqueFunctionPtr Function, OpaqueFunctionPtr Target, uint64_t& OutOriginalPrologue);
+    /** Reverts RedirectGeneratedFunction */
+    void RestoreGeneratedFunction(OpaqueFunctionPtr Function, uint64_t OriginalPrologue);
+    /**
+     * Generates stub calling ResolveFunction with the provided context, preserving all argument registers,
+     * and then tail-jumping to the function it returned, so the stub can stand in for the resolved function
+     */
+    OpaqueFunctionPtr GenerateResolveOnCallStub(void* Context, ResolveOnCallFunctionPtr ResolveFunction);
 private:
     /**
     * Generates destructor call for the given symbol
     * RCX should be set to the this pointer of the object being destructor
-    * @param BasePtr pointer to the location in memory where executable is loaded
-    * @param StackOffset offset on the rsp to the beginning of the first variable
+    * Arrays are destroyed in a loop keeping its state in rbx and rsi, which should be saved by the caller
     */
-    void GenerateDestructorCall(const CComPtr<IDiaSymbol>& Symbol, asmjit::x86::Builder& a, uint64_t StackOffset);
+    void GenerateDestructorCall(const CComPtr<IDiaSymbol>& Symbol, asmjit::x86::Builder& a);
+    /**
+     * Returns true if destroying value of the given type doesn't need to call anything, e.g. primitive types,
+     * pointers and UDTs without destructor which have only such members and base classes. Cached per UDT
+     */
+    bool IsTriviallyDestructible(const CComPtr<IDiaSymbol>& Symbol);
+    /** Returns true if destructor call should be generated for the member or base class of the given type */
+    bool NeedsDestructorCall(const CComPtr<IDiaSymbol>& Symbol);
+    /** Returns true if any of the member variables is an array which needs destructor loop */
+    bool HasArrayMembersToDestroy(IDiaEnumSymbols* ClassVariables);
     DestructorFunctionPtr FindOrGenerateDestructorFunction(const CComPtr<IDiaSymbol>& ClassSymbol);
     DestructorFunctionPtr GenerateDestructorFunction(const CComPtr<IDiaSymbol>& ClassSymbol);
     DummyFunctionPtr DoGenerateDummyFunction(const std::string& FunctionName, DummyFunctionCallHandler CallHandler);
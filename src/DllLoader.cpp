@@ -2,9 +2,19 @@
 #include "logging.h"
 #include <Psapi.h>
 #include "util.h"
+#include "config.h"
+#include "DestructorGenerator.h"
+#include <mutex>
 #define MAX_NAME_LENGTH 2048
 
-DllLoader::DllLoader(SymbolResolver* importResolver) : resolver(importResolver), dbgHelpModule(nullptr) {}
+DllLoader::DllLoader(SymbolResolver* importResolver, const path& importCacheDirectory, uint32_t workerThreadCount) :
+        resolver(importResolver), dbgHelpModule(nullptr), importCacheDirectory(importCacheDirectory), gameImageSize(0),
+        workerPool(std::make_unique<WorkerPool>(workerThreadCount)) {
+    PeImage gameImage;
+    if (gameImage.OpenLoadedImage(resolver->dllBaseAddress)) {
+        gameImageSize = gameImage.GetSizeOfImage();
+    }
+}
 
 typedef BOOL (WINAPI *DllEntryProc)(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpReserved);
 
@@ -12,45 +22,201 @@ typedef DWORD64 (__stdcall *SymLoadModuleExW)(HANDLE hProcess, HANDLE hFile, PCW
 typedef bool (__stdcall *SymSetSearchPathW)(HANDLE hProcess, PCWSTR SearchPathStr);
 typedef bool (__stdcall *SymUnloadModule64)(HANDLE hProcess, DWORD64 BaseOfDll);
 
-void UnprotectPageIfNeeded(void* pagePointer, DWORD pageRangeSize);
-
-bool ResolveDllImportsInternal(std::unordered_set<std::string>& alreadyLoadedLibraries, SymbolResolver* resolver, unsigned char* codeBase, PIMAGE_IMPORT_DESCRIPTOR importDesc);
+/** Computes range of memory occupied by the import address tables of the module */
+void GetImportAddressTableSpan(const PeImage& image, uint32_t& outSpanStart, uint32_t& outSpanSize) {
+    const PeDataDirectory iatDir = image.GetDataDirectory(PeDirectory_ImportAddressTable);
+    if (iatDir.Size != 0) {
+        outSpanStart = iatDir.VirtualAddress;
+        outSpanSize = iatDir.Size;
+        return;
+    }
+    //linker didn't emit IAT directory, so compute bounds from the thunk arrays themselves
+    uint32_t spanStart = UINT32_MAX;
+    uint32_t spanEnd = 0;
+    image.ForEachImportDescriptor([&](const PeImportDescriptor& descriptor) {
+        return image.ForEachImport(descriptor, [&](const PeImport& import) {
+            if (import.AddressSlotRva < spanStart) spanStart = import.AddressSlotRva;
+            if (import.AddressSlotRva + sizeof(uintptr_t) > spanEnd) spanEnd = import.AddressSlotRva + sizeof(uintptr_t);
+            return true;
+        });
+    });
+    outSpanStart = spanStart;
+    outSpanSize = spanEnd > spanStart ? spanEnd - spanStart : 0;
+}
 
 HMODULE DllLoader::LoadModule(const path& filePath) {
-    HMODULE preloadedModule = GetModuleHandleW(filePath.filename().c_str());
-    if (preloadedModule != nullptr) {
-        //don't try to load the same module twice.
-        return preloadedModule;
-    }
-    auto* baseDll = reinterpret_cast<unsigned char *>(LoadLibraryExW(filePath.c_str(), nullptr, DONT_RESOLVE_DLL_REFERENCES));
-    Logging::logFile << "Loaded Raw DLL module: " << baseDll << std::endl;
-    auto dosHeader = (PIMAGE_DOS_HEADER) baseDll;
-    Logging::logFile << "Casted module to dos header " << dosHeader << std::endl;
-    Logging::logFile << "Magic: " << dosHeader->e_magic << " Expected Magic: " << IMAGE_DOS_SIGNATURE << std::endl;
-    auto pNTHeader = (PIMAGE_NT_HEADERS) ((LONGLONG) dosHeader + dosHeader->e_lfanew);
-    auto importsDir = (PIMAGE_DATA_DIRECTORY) &(pNTHeader->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT]);
-    if (importsDir->Size) {
-        Logging::logFile << "Import Directory Size: " << importsDir->Size << std::endl;
-        auto baseImp = (PIMAGE_IMPORT_DESCRIPTOR) (baseDll + importsDir->VirtualAddress);
-        UnprotectPageIfNeeded(reinterpret_cast<void*>(baseImp), importsDir->Size);
-        if (!ResolveDllImportsInternal(alreadyLoadedLibraries, resolver, baseDll, baseImp)) {
-            Logging::logFile << "LoadModule failed: Cannot resolve imports of the library" << std::endl;
-            return nullptr;
+    return LoadModules({filePath})[0];
+}
+
+std::vector<HMODULE> DllLoader::LoadModules(const std::vector<path>& filePaths) {
+    std::vector<HMODULE> resultModules(filePaths.size());
+    std::vector<LoadingModule> loadingModules(filePaths.size());
+    //map all modules first without resolving anything, so imports of all of them can be inspected
+    //mapping is serialized by the loader lock anyway, so it is done on the calling thread
+    for (size_t i = 0; i < filePaths.size(); i++) {
+        HMODULE preloadedModule = GetModuleHandleW(filePaths[i].filename().c_str());
+        if (preloadedModule != nullptr) {
+            //don't try to load the same module twice.
+            resultModules[i] = preloadedModule;
+            continue;
+        }
+        HMODULE baseDll = LoadLibraryExW(filePaths[i].c_str(), nullptr, DONT_RESOLVE_DLL_REFERENCES);
+        Logging::logFile << "Loaded Raw DLL module: " << baseDll << std::endl;
+        if (baseDll == nullptr) {
+            Logging::logFile << "LoadModule failed: Cannot map library " << filePaths[i].filename() << std::endl;
+            continue;
+        }
+        if (!loadingModules[i].Image.OpenLoadedImage(baseDll)) {
+            Logging::logFile << "LoadModule failed: Library has malformed PE headers " << filePaths[i].filename() << std::endl;
+        }
+    }
+    if (workerPool->GetWorkerCount() != 0) {
+        Logging::logFile << "Resolving imports of loader modules on " << workerPool->GetWorkerCount() << " worker threads" << std::endl;
+    }
+    workerPool->ParallelFor(filePaths.size(), [&](size_t i) {
+        if (loadingModules[i].Image.GetData() != nullptr) {
+            OpenModuleBindingCache(filePaths[i], loadingModules[i].BindingCache);
+        }
+    });
+    for (size_t i = 0; i < filePaths.size(); i++) {
+        const ModuleBindingCache& bindingCache = loadingModules[i].BindingCache;
+        if (bindingCache.Cache.IsOpen()) {
+            Logging::logFile << "Using import binding cache of " << filePaths[i].filename() << " with " << bindingCache.Cache.GetEntryCount() << " entries" << std::endl;
+        } else if (bindingCache.bEnabled) {
+            Logging::logFile << "Import binding cache of " << filePaths[i].filename() << " is missing or outdated, it will be rebuilt" << std::endl;
+        }
+    }
+
+    //collect game symbols imported by all modules and resolve each of them only once
+    ResolvedSymbolMap resolvedSymbols;
+    size_t totalSymbolImports = 0;
+    for (LoadingModule& module : loadingModules) {
+        if (module.Image.GetData() != nullptr) {
+            totalSymbolImports += CollectGameSymbolImports(module.Image, module.BindingCache, resolvedSymbols);
+        }
+    }
+    Logging::logFile << "Resolving game symbol imports: " << totalSymbolImports << " total, ";
+    Logging::logFile << resolvedSymbols.size() << " after deduplication" << std::endl;
+    //map itself is not modified during resolution, only values of the distinct entries
+    std::vector<ResolvedSymbolMap::value_type*> symbolEntries;
+    symbolEntries.reserve(resolvedSymbols.size());
+    for (auto& symbolEntry : resolvedSymbols) {
+        symbolEntries.push_back(&symbolEntry);
+    }
+    std::atomic<size_t> lazyImportCount{0};
+    workerPool->ParallelFor(symbolEntries.size(), [&](size_t i) {
+        //symbol names are null terminated since they point directly into the import tables
+        const char* symbolName = symbolEntries[i]->first.data();
+        GameSymbolImport& symbolImport = symbolEntries[i]->second;
+        //data cannot be bound on call, and functions imported by several modules are likely to be called anyway
+        if (Config::lazyImportBinding && symbolImport.ImportCount == 1 && resolver->IsFunctionSymbol(symbolName)) {
+            symbolImport.bBindLazily = true;
+            lazyImportCount++;
+            return;
+        }
+        symbolImport.Address = resolver->ResolveSymbol(symbolName);
+    });
+    if (Config::lazyImportBinding) {
+        Logging::logFile << "Deferred binding of " << lazyImportCount.load() << " game function imports to their first call" << std::endl;
+    }
+
+    //patch import tables of all modules in parallel, but call entry points strictly in the order modules were passed
+    workerPool->ParallelFor(filePaths.size(), [&](size_t i) {
+        if (loadingModules[i].Image.GetData() != nullptr) {
+            BindModuleImports(loadingModules[i], resolvedSymbols);
+        }
+    });
+    for (size_t i = 0; i < filePaths.size(); i++) {
+        if (loadingModules[i].Image.GetData() != nullptr && InitializeModule(loadingModules[i])) {
+            resultModules[i] = (HMODULE) loadingModules[i].Image.GetData();
+        }
+    }
+    return resultModules;
+}
+
+void DllLoader::OpenModuleBindingCache(const path& modulePath, ModuleBindingCache& bindingCache) {
+    if (importCacheDirectory.empty() || !resolver->GetGameSignature(bindingCache.GameSignature)) {
+        return;
+    }
+    //cached bindings are only valid for the exact module build, so key them by the file contents
+    MappedFile moduleFile;
+    if (!moduleFile.Open(modulePath)) {
+        return;
+    }
+    bindingCache.ModuleHash = HashModuleContents(moduleFile.GetData(), moduleFile.GetSize());
+    bindingCache.CacheFilePath = importCacheDirectory / modulePath.filename();
+    bindingCache.CacheFilePath += ".bin";
+    bindingCache.bEnabled = true;
+    bindingCache.Cache.OpenFile(bindingCache.CacheFilePath, bindingCache.GameSignature, bindingCache.ModuleHash);
+}
+
+bool DllLoader::SaveModuleBindingCache(ModuleBindingCache& bindingCache) {
+    if (!bindingCache.bEnabled || bindingCache.Cache.IsOpen()) {
+        return true;
+    }
+    std::error_code errorCode;
+    std::filesystem::create_directories(importCacheDirectory, errorCode);
+    const std::vector<uint8_t> cacheData = bindingCache.Builder.Serialize(bindingCache.GameSignature, bindingCache.ModuleHash);
+    return WriteCacheFile(bindingCache.CacheFilePath, cacheData);
+}
+
+void DllLoader::BindModuleImports(LoadingModule& module, const ResolvedSymbolMap& resolvedSymbols) {
+    const PeImage& image = module.Image;
+    auto* baseDll = const_cast<unsigned char*>(image.GetData());
+    if (image.GetDataDirectory(PeDirectory_Import).Size == 0) {
+        module.bImportsBound = true;
+        return;
+    }
+    //make whole IAT writable at once instead of doing it for each thunk, and restore protection afterwards
+    uint32_t iatSpanStart;
+    GetImportAddressTableSpan(image, iatSpanStart, module.IatSpanSize);
+    DWORD oldProtection = 0;
+    if (module.IatSpanSize != 0 && VirtualProtect(baseDll + iatSpanStart, module.IatSpanSize, PAGE_READWRITE, &oldProtection)) {
+        module.ProtectionChangeCount++;
+    }
+    module.bImportsBound = ResolveDllImports(image, resolvedSymbols, module);
+    if (module.ProtectionChangeCount != 0 && VirtualProtect(baseDll + iatSpanStart, module.IatSpanSize, oldProtection, &oldProtection)) {
+        module.ProtectionChangeCount++;
+    }
+    if (module.bImportsBound && !SaveModuleBindingCache(module.BindingCache)) {
+        module.BindingMessages.push_back("[WARNING] Failed to write import binding cache " + module.BindingCache.CacheFilePath.string());
+    }
+}
+
+bool DllLoader::InitializeModule(LoadingModule& module) {
+    const PeImage& image = module.Image;
+    auto* baseDll = const_cast<unsigned char*>(image.GetData());
+    const PeDataDirectory importsDir = image.GetDataDirectory(PeDirectory_Import);
+    if (importsDir.Size != 0) {
+        Logging::logFile << "Import Directory Size: " << importsDir.Size << std::endl;
+        for (const std::string& message : module.BindingMessages) {
+            Logging::logFile << message << std::endl;
+        }
+        if (module.IatSpanSize != 0 && module.ProtectionChangeCount == 0) {
+            Logging::logFile << "[WARNING] Failed to make IAT writable" << std::endl;
         }
+        if (module.CachedBindingCount != 0) {
+            Logging::logFile << "Bound " << module.CachedBindingCount << " game symbol imports from the import binding cache" << std::endl;
+        }
+        Logging::logFile << "Patched IAT of " << module.IatSpanSize << " bytes with " << module.ProtectionChangeCount << " protection changes" << std::endl;
+    }
+    if (!module.bImportsBound) {
+        Logging::logFile << "LoadModule failed: Cannot resolve imports of the library" << std::endl;
+        return false;
     }
     Logging::logFile << "Resolved imports successfully; Calling DllMain" << std::endl;
-    if (pNTHeader->OptionalHeader.AddressOfEntryPoint != 0) {
-        auto DllEntry = (DllEntryProc)(LPVOID)(baseDll + pNTHeader->OptionalHeader.AddressOfEntryPoint);
+    if (image.GetAddressOfEntryPoint() != 0) {
+        auto DllEntry = (DllEntryProc)(LPVOID)(baseDll + image.GetAddressOfEntryPoint());
         // notify library about attaching to process
         BOOL successful = (*DllEntry)((HINSTANCE) baseDll, DLL_PROCESS_ATTACH, nullptr);
         if (!successful) {
             Logging::logFile << "LoadModule failed: DllEntry returned false for library" << std::endl;
-            return nullptr;
+            return false;
         }
     }
     Logging::logFile << "Called DllMain successfully on DLL. Loading finished." << std::endl;
     TryToLoadModulePDB((HMODULE) baseDll);
-    return (HINSTANCE) baseDll;
+    return true;
 }
 
 /** @return path to directory containing DLL and PDB files */
@@ -110,62 +276,121 @@ void DllLoader::TryToLoadModulePDB(HMODULE module) {
     }
 }
 
-bool ResolveDllImportsInternal(std::unordered_set<std::string>& alreadyLoadedLibraries, SymbolResolver* resolver, unsigned char* codeBase, PIMAGE_IMPORT_DESCRIPTOR importDesc) {
-    for (; importDesc->Name; importDesc++) {
-        uintptr_t *thunkRef;
-        FARPROC *funcRef;
-        if (importDesc->OriginalFirstThunk) {
-            thunkRef = (uintptr_t *) (codeBase + importDesc->OriginalFirstThunk);
-            funcRef = (FARPROC *) (codeBase + importDesc->FirstThunk);
-        } else {
-            // no hint table
-            thunkRef = (uintptr_t *) (codeBase + importDesc->FirstThunk);
-            funcRef = (FARPROC *) (codeBase + importDesc->FirstThunk);
-        }
-        const char* libraryName = (LPCSTR) (codeBase + importDesc->Name);
-
-        HMODULE libraryHandle = GetModuleHandleA(libraryName);
-        if (libraryHandle == nullptr) {
-            std::string libraryNameString = libraryName;
-            //try to load library only once
-            if (alreadyLoadedLibraries.count(libraryNameString) == 0) {
-                //load library if it exists, fallback to symbol resolver
-                libraryHandle = LoadLibraryA(libraryName);
-                alreadyLoadedLibraries.insert(std::move(libraryNameString));
-            }
+HMODULE DllLoader::FindImportLibrary(const char* libraryName) {
+    HMODULE libraryHandle = GetModuleHandleA(libraryName);
+    if (libraryHandle == nullptr) {
+        std::lock_guard guard(importLibraryMutex);
+        std::string libraryNameString = libraryName;
+        //try to load library only once
+        if (alreadyLoadedLibraries.count(libraryNameString) == 0) {
+            //load library if it exists, fallback to symbol resolver
+            libraryHandle = LoadLibraryA(libraryName);
+            alreadyLoadedLibraries.insert(std::move(libraryNameString));
         }
-        //iterate all thunk import entries and resolve them
-        for (; *thunkRef; thunkRef++, funcRef++) {
-            const char* importDescriptor;
-            if (IMAGE_SNAP_BY_ORDINAL(*thunkRef)) {
-                importDescriptor = (LPCSTR)IMAGE_ORDINAL(*thunkRef);
-            } else {
-                auto thunkData = (PIMAGE_IMPORT_BY_NAME) (codeBase + (*thunkRef));
-                importDescriptor = (LPCSTR)&thunkData->Name;
+    }
+    return libraryHandle;
+}
+
+static std::mutex lazyImportMutex;
+
+void* ResolveLazyImport(void* Context) {
+    auto* importEntry = reinterpret_cast<LazyImportEntry*>(Context);
+    std::lock_guard guard(lazyImportMutex);
+    //other threads could have entered the stub before IAT slot was patched
+    if (importEntry->ResolvedAddress == nullptr) {
+        importEntry->ResolvedAddress = importEntry->Resolver->ResolveSymbol(importEntry->SymbolName);
+        DWORD oldProtection;
+        VirtualProtect(importEntry->AddressSlot, sizeof(FARPROC), PAGE_READWRITE, &oldProtection);
+        *importEntry->AddressSlot = reinterpret_cast<FARPROC>(importEntry->ResolvedAddress);
+        VirtualProtect(importEntry->AddressSlot, sizeof(FARPROC), oldProtection, &oldProtection);
+    }
+    return importEntry->ResolvedAddress;
+}
+
+FARPROC DllLoader::CreateLazyImportStub(FARPROC* addressSlot, const char* symbolName) {
+    std::unique_lock guard(lazyImportEntriesMutex);
+    LazyImportEntry& importEntry = lazyImportEntries.emplace_back(LazyImportEntry{resolver, addressSlot, symbolName, nullptr});
+    guard.unlock();
+    return reinterpret_cast<FARPROC>(resolver->destructorGenerator->GenerateResolveOnCallStub(&importEntry, &ResolveLazyImport));
+}
+
+size_t DllLoader::CollectGameSymbolImports(const PeImage& image, const ModuleBindingCache& bindingCache, ResolvedSymbolMap& gameSymbols) {
+    size_t symbolImportCount = 0;
+    image.ForEachImportDescriptor([&](const PeImportDescriptor& descriptor) {
+        //library names point into the image, so they are null terminated
+        if (FindImportLibrary(descriptor.LibraryName.data()) != nullptr) {
+            return true;
+        }
+        return image.ForEachImport(descriptor, [&](const PeImport& import) {
+            //game symbols can only be imported by name, ordinals are left to the regular resolution
+            //imports bound to the game image by the cache don't need symbol lookup at all
+            const ImportBindingEntry* cachedBinding = bindingCache.Cache.FindBinding(import.AddressSlotRva);
+            if (cachedBinding != nullptr && cachedBinding->Kind == ImportBinding_GameImage) {
+                return true;
             }
-            UnprotectPageIfNeeded(reinterpret_cast<void*>(funcRef), 1);
-            if (libraryHandle == nullptr) {
-                //library handle is empty, attempt symbol resolution
-                *funcRef = reinterpret_cast<FARPROC>(resolver->ResolveSymbol(importDescriptor));
-            } else {
+            if (!import.bByOrdinal) {
+                gameSymbols[import.Name].ImportCount++;
+                symbolImportCount++;
+            }
+            return true;
+        });
+    });
+    return symbolImportCount;
+}
+
+bool DllLoader::ResolveDllImports(const PeImage& image, const ResolvedSymbolMap& resolvedSymbols, LoadingModule& module) {
+    ModuleBindingCache& bindingCache = module.BindingCache;
+    auto* codeBase = const_cast<unsigned char*>(image.GetData());
+    auto* gameBase = reinterpret_cast<unsigned char*>(resolver->dllBaseAddress);
+    const bool bResolvedImports = image.ForEachImportDescriptor([&](const PeImportDescriptor& descriptor) {
+        const char* libraryName = descriptor.LibraryName.data();
+        HMODULE libraryHandle = FindImportLibrary(libraryName);
+
+        //iterate all thunk import entries and resolve them
+        return image.ForEachImport(descriptor, [&](const PeImport& import) {
+            auto* funcRef = (FARPROC*) (codeBase + import.AddressSlotRva);
+            const char* importDescriptor = import.bByOrdinal ? (LPCSTR) (uintptr_t) import.Ordinal : import.Name.data();
+            if (libraryHandle != nullptr) {
                 //we have a library reference for a given import, so use GetProcAddress
                 *funcRef = GetProcAddress(libraryHandle, importDescriptor);
+            } else if (import.bByOrdinal) {
+                //game symbols don't have ordinals
+                *funcRef = nullptr;
+            } else if (const ImportBindingEntry* cachedBinding = bindingCache.Cache.FindBinding(import.AddressSlotRva);
+                    cachedBinding != nullptr && cachedBinding->Kind == ImportBinding_GameImage) {
+                *funcRef = reinterpret_cast<FARPROC>(gameBase + cachedBinding->TargetRva);
+                module.CachedBindingCount++;
+            } else {
+                //library handle is empty, use symbol resolved during pre-scan
+                auto iterator = resolvedSymbols.find(import.Name);
+                if (iterator != resolvedSymbols.end() && iterator->second.bBindLazily) {
+                    *funcRef = CreateLazyImportStub(funcRef, importDescriptor);
+                } else if (iterator != resolvedSymbols.end()) {
+                    *funcRef = reinterpret_cast<FARPROC>(iterator->second.Address);
+                } else {
+                    *funcRef = reinterpret_cast<FARPROC>(resolver->ResolveSymbol(importDescriptor));
+                }
+                if (bindingCache.bEnabled && !bindingCache.Cache.IsOpen() && *funcRef != nullptr) {
+                    //generated destructors, provided symbols and lazy stubs live outside of the game image
+                    //and are different on each launch, so only record that they need to be resolved again
+                    auto* targetAddress = reinterpret_cast<unsigned char*>(*funcRef);
+                    if (targetAddress >= gameBase && targetAddress < gameBase + gameImageSize) {
+                        bindingCache.Builder.AddBinding(import.AddressSlotRva, ImportBinding_GameImage, (uint32_t) (targetAddress - gameBase));
+                    } else {
+                        bindingCache.Builder.AddBinding(import.AddressSlotRva, ImportBinding_Resolve, 0);
+                    }
+                }
             }
             if (*funcRef == nullptr) {
-                Logging::logFile << "Failed to resolve import of symbol " << importDescriptor << " from " << libraryName << std::endl;
+                if (import.bByOrdinal) {
+                    module.BindingMessages.push_back("Failed to resolve import by ordinal " + std::to_string(import.Ordinal) + " from " + libraryName);
+                } else {
+                    module.BindingMessages.push_back("Failed to resolve import of symbol " + std::string(importDescriptor) + " from " + libraryName);
+                }
                 return false;
             }
-        }
-    }
-    return true;
+            return true;
+        });
+    });
+    return bResolvedImports;
 }
-
-//checks if memory page is protected and changes access to PAGE_READWRITE if it is protected
-void UnprotectPageIfNeeded(void* pagePointer, DWORD pageRangeSize) {
-    MEMORY_BASIC_INFORMATION memoryInfo;
-    auto result = VirtualQuery(pagePointer, &memoryInfo, sizeof(memoryInfo));
-    if ((memoryInfo.Protect & PAGE_READONLY) > 0) {
-        Logging::logFile << "Removing protection from page " << pagePointer << std::endl;
-        VirtualProtect(pagePointer, 1, PAGE_READWRITE, &memoryInfo.Protect);
-    }
-}
\ No newline at end of file
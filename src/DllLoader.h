@@ -5,23 +5,63 @@
 #include <windows.h>
 #include <vector>
 #include <unordered_set>
+#include <unordered_map>
+#include <string_view>
+#include <deque>
 #include "SymbolResolver.h"
+#include "PeImage.h"
+#include "ImportBindingCache.h"
+#include "WorkerPool.h"
+#include <memory>
+#include <mutex>
 #include <filesystem>
 using path = std::filesystem::path;
 
+/** Import bound on the first call through the generated stub */
+struct LazyImportEntry {
+    SymbolResolver* Resolver;
+    FARPROC* AddressSlot;
+    //points into the import table of the module
+    const char* SymbolName;
+    void* ResolvedAddress;
+};
+
 class DllLoader {
 public:
     SymbolResolver* resolver;
     std::unordered_set<std::wstring> pdbRootDirectories;
 private:
+    std::mutex importLibraryMutex;
     std::unordered_set<std::string> alreadyLoadedLibraries;
     std::vector<HMODULE> delayedModulePDBs;
     HMODULE dbgHelpModule;
+    //stubs reference entries directly, so they should never be moved
+    std::mutex lazyImportEntriesMutex;
+    std::deque<LazyImportEntry> lazyImportEntries;
+    //empty if import binding caching is disabled
+    path importCacheDirectory;
+    uint32_t gameImageSize;
+    std::unique_ptr<WorkerPool> workerPool;
 public:
-    explicit DllLoader(SymbolResolver* importResolver);
+    /**
+     * @param importCacheDirectory directory for persistent import binding caches of loader modules,
+     * or empty path to always resolve imports from scratch
+     * @param workerThreadCount amount of threads resolving imports in addition to the calling one,
+     * should be zero when modules are loaded under the loader lock, since worker threads can't start then
+     */
+    DllLoader(SymbolResolver* importResolver, const path& importCacheDirectory, uint32_t workerThreadCount);
 
     HMODULE LoadModule(const path& filePath);
 
+    /**
+     * Loads multiple modules at once. Imports of all modules are scanned first,
+     * and game symbols they need are resolved in a single pass, so symbols imported
+     * by several modules are only looked up once. Symbols and import tables are resolved on the worker pool,
+     * but DllMain is always called on the calling thread in the order modules are passed
+     * @return loaded module handles in the same order, nullptr for modules that failed to load
+     */
+    std::vector<HMODULE> LoadModules(const std::vector<path>& filePaths);
+
     /**
      * Flushes all delay loaded PDBs into the
      * symbol storage for the loaded DbgHelp.dll instance
@@ -30,6 +70,57 @@ public:
      */
     void FlushDebugSymbols();
 private:
+    struct GameSymbolImport {
+        void* Address = nullptr;
+        uint32_t ImportCount = 0;
+        //resolved by a stub on the first call instead of during loading
+        bool bBindLazily = false;
+    };
+    typedef std::unordered_map<std::string_view, GameSymbolImport> ResolvedSymbolMap;
+
+    /** Import binding cache of the module being loaded */
+    struct ModuleBindingCache {
+        bool bEnabled = false;
+        path CacheFilePath;
+        uint64_t ModuleHash = 0;
+        PdbSignature GameSignature{};
+        ImportBindingCache Cache;
+        //records bindings when cache is missing or outdated
+        ImportBindingCacheBuilder Builder;
+    };
+
+    /** Module being loaded by LoadModules */
+    struct LoadingModule {
+        PeImage Image;
+        ModuleBindingCache BindingCache;
+        //results of binding imports on the worker thread, logged when the module is initialized
+        bool bImportsBound = false;
+        uint32_t IatSpanSize = 0;
+        uint32_t ProtectionChangeCount = 0;
+        uint32_t CachedBindingCount = 0;
+        //worker threads can't write into the log, so failures are recorded and logged along with the rest
+        std::vector<std::string> BindingMessages;
+    };
+
+    /** Opens import binding cache of the module, leaving it disabled if game or module build can't be identified */
+    void OpenModuleBindingCache(const path& modulePath, ModuleBindingCache& bindingCache);
+    /**
+     * Writes bindings recorded during resolution if the module didn't have a valid cache
+     * @return false if cache file couldn't be written
+     */
+    bool SaveModuleBindingCache(ModuleBindingCache& bindingCache);
+
+    /** Returns handle of the library providing imports, or nullptr if imports should be resolved from the game */
+    HMODULE FindImportLibrary(const char* libraryName);
+    /** Collects names of imported game symbols, returns total amount of game symbol imports */
+    size_t CollectGameSymbolImports(const PeImage& image, const ModuleBindingCache& bindingCache, ResolvedSymbolMap& gameSymbols);
+    bool ResolveDllImports(const PeImage& image, const ResolvedSymbolMap& resolvedSymbols, LoadingModule& module);
+    /** Patches import table of the module. Safe to call for different modules in parallel */
+    void BindModuleImports(LoadingModule& module, const ResolvedSymbolMap& resolvedSymbols);
+    /** Calls DllMain of the module with imports already bound */
+    bool InitializeModule(LoadingModule& module);
+    /** Generates stub resolving the symbol and patching the address slot on the first call */
+    FARPROC CreateLazyImportStub(FARPROC* addressSlot, const char* symbolName);
     void LoadModulePDBInternal(HMODULE module);
     void TryToLoadModulePDB(HMODULE module);
 };
@@ -0,0 +1,70 @@
+#include "ImportBindingCache.h"
+#include <algorithm>
+#include <cstring>
+
+#define FNV1A_64_OFFSET_BASIS 0xCBF29CE484222325ull
+#define FNV1A_64_PRIME 0x100000001B3ull
+
+ImportBindingCache::ImportBindingCache() : Header(nullptr), Entries(nullptr) {}
+
+bool ImportBindingCache::OpenFile(const std::filesystem::path& FilePath, const PdbSignature& GameSignature, uint64_t ModuleHash) {
+    if (!File.Open(FilePath)) {
+        return false;
+    }
+    const uint8_t* Data = File.GetData();
+    const size_t Size = File.GetSize();
+    auto* FileHeader = reinterpret_cast<const ImportBindingCacheHeader*>(Data);
+    if (Size < sizeof(ImportBindingCacheHeader) ||
+        FileHeader->Magic != IMPORT_BINDING_CACHE_MAGIC || FileHeader->Version != IMPORT_BINDING_CACHE_VERSION ||
+        sizeof(ImportBindingCacheHeader) + (uint64_t) FileHeader->EntryCount * sizeof(ImportBindingEntry) != Size ||
+        FileHeader->GameSignature != GameSignature || FileHeader->ModuleHash != ModuleHash) {
+        File.Close();
+        return false;
+    }
+    Header = FileHeader;
+    Entries = reinterpret_cast<const ImportBindingEntry*>(Data + sizeof(ImportBindingCacheHeader));
+    return true;
+}
+
+const ImportBindingEntry* ImportBindingCache::FindBinding(uint32_t SlotRva) const {
+    if (Header == nullptr) {
+        return nullptr;
+    }
+    const ImportBindingEntry* EntriesEnd = Entries + Header->EntryCount;
+    const ImportBindingEntry* Entry = std::lower_bound(Entries, EntriesEnd, SlotRva, [](const ImportBindingEntry& Binding, uint32_t Rva) {
+        return Binding.SlotRva < Rva;
+    });
+    return Entry != EntriesEnd && Entry->SlotRva == SlotRva ? Entry : nullptr;
+}
+
+void ImportBindingCacheBuilder::AddBinding(uint32_t SlotRva, ImportBindingKind Kind, uint32_t TargetRva) {
+    Entries.push_back(ImportBindingEntry{SlotRva, Kind, TargetRva});
+}
+
+std::vector<uint8_t> ImportBindingCacheBuilder::Serialize(const PdbSignature& GameSignature, uint64_t ModuleHash) {
+    std::sort(Entries.begin(), Entries.end(), [](const ImportBindingEntry& First, const ImportBindingEntry& Second) {
+        return First.SlotRva < Second.SlotRva;
+    });
+    ImportBindingCacheHeader Header{};
+    Header.Magic = IMPORT_BINDING_CACHE_MAGIC;
+    Header.Version = IMPORT_BINDING_CACHE_VERSION;
+    Header.GameSignature = GameSignature;
+    Header.ModuleHash = ModuleHash;
+    Header.EntryCount = (uint32_t) Entries.size();
+
+    std::vector<uint8_t> Result(sizeof(Header) + Entries.size() * sizeof(ImportBindingEntry));
+    memcpy(Result.data(), &Header, sizeof(Header));
+    if (!Entries.empty()) {
+        memcpy(Result.data() + sizeof(Header), Entries.data(), Entries.size() * sizeof(ImportBindingEntry));
+    }
+    return Result;
+}
+
+uint64_t HashModuleContents(const uint8_t* Data, size_t Size) {
+    uint64_t Hash = FNV1A_64_OFFSET_BASIS;
+    for (size_t i = 0; i < Size; i++) {
+        Hash ^= Data[i];
+        Hash *= FNV1A_64_PRIME;
+    }
+    return Hash;
+}
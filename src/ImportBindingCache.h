@@ -0,0 +1,73 @@
+#ifndef XINPUT1_3_IMPORTBINDINGCACHE_H
+#define XINPUT1_3_IMPORTBINDINGCACHE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <filesystem>
+#include "MappedFile.h"
+#include "SymbolIndex.h"
+
+enum ImportBindingKind : uint32_t {
+    //Import is bound to the game image, TargetRva is relative to its base
+    ImportBinding_GameImage = 0,
+    //Import is bound to the code generated by the bootstrapper or provided by it, and should be resolved again
+    ImportBinding_Resolve = 1
+};
+
+//--- ON-DISK FORMAT. BUMP IMPORT_BINDING_CACHE_VERSION WHEN CHANGING LAYOUT OF THESE STRUCTS ---
+#define IMPORT_BINDING_CACHE_MAGIC 0x58444942 //'BIDX'
+#define IMPORT_BINDING_CACHE_VERSION 1
+
+struct ImportBindingCacheHeader {
+    uint32_t Magic;
+    uint32_t Version;
+    uint64_t ModuleHash;
+    PdbSignature GameSignature;
+    uint32_t EntryCount;
+};
+
+//Entries are sorted by SlotRva
+struct ImportBindingEntry {
+    //Relative virtual address of the IAT slot in the loader module
+    uint32_t SlotRva;
+    uint32_t Kind;
+    uint32_t TargetRva;
+};
+
+/**
+ * Game symbol imports of a single loader module resolved on the previous launch
+ * Valid only for the same game PDB and the same module file contents
+ */
+class ImportBindingCache {
+private:
+    MappedFile File;
+    const ImportBindingCacheHeader* Header;
+    const ImportBindingEntry* Entries;
+public:
+    ImportBindingCache();
+
+    /** Maps cache file, returns false if it is missing, malformed or was built for another game or module build */
+    bool OpenFile(const std::filesystem::path& FilePath, const PdbSignature& GameSignature, uint64_t ModuleHash);
+
+    inline bool IsOpen() const { return Header != nullptr; }
+    inline uint32_t GetEntryCount() const { return Header ? Header->EntryCount : 0; }
+
+    /** @return binding of the given IAT slot, or nullptr if it wasn't recorded */
+    const ImportBindingEntry* FindBinding(uint32_t SlotRva) const;
+};
+
+class ImportBindingCacheBuilder {
+private:
+    std::vector<ImportBindingEntry> Entries;
+public:
+    void AddBinding(uint32_t SlotRva, ImportBindingKind Kind, uint32_t TargetRva);
+    inline size_t GetBindingCount() const { return Entries.size(); }
+
+    std::vector<uint8_t> Serialize(const PdbSignature& GameSignature, uint64_t ModuleHash);
+};
+
+/** 64-bit FNV-1a hash of the module file contents, used to detect changed modules */
+uint64_t HashModuleContents(const uint8_t* Data, size_t Size);
+
+#endif //XINPUT1_3_IMPORTBINDINGCACHE_H
@@ -0,0 +1,94 @@
+#include "MappedFile.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : FileHandle(nullptr), MappingHandle(nullptr), Data(nullptr), Size(0) {}
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::filesystem::path& FilePath) {
+    Close();
+    HANDLE File = CreateFileW(FilePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (File == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER FileSize;
+    //empty files cannot be mapped, and they are useless for us anyway
+    if (!GetFileSizeEx(File, &FileSize) || FileSize.QuadPart == 0) {
+        CloseHandle(File);
+        return false;
+    }
+    HANDLE Mapping = CreateFileMappingW(File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (Mapping == nullptr) {
+        CloseHandle(File);
+        return false;
+    }
+    void* View = MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+    if (View == nullptr) {
+        CloseHandle(Mapping);
+        CloseHandle(File);
+        return false;
+    }
+    FileHandle = File;
+    MappingHandle = Mapping;
+    Data = reinterpret_cast<const uint8_t*>(View);
+    Size = (size_t) FileSize.QuadPart;
+    return true;
+}
+
+void MappedFile::Close() {
+    if (Data != nullptr) {
+        UnmapViewOfFile(Data);
+        CloseHandle(MappingHandle);
+        CloseHandle(FileHandle);
+    }
+    FileHandle = nullptr;
+    MappingHandle = nullptr;
+    Data = nullptr;
+    Size = 0;
+}
+
+#else
+
+bool MappedFile::Open(const std::filesystem::path& FilePath) {
+    Close();
+    int FileDescriptor = open(FilePath.c_str(), O_RDONLY);
+    if (FileDescriptor < 0) {
+        return false;
+    }
+    struct stat FileStat{};
+    if (fstat(FileDescriptor, &FileStat) != 0 || FileStat.st_size == 0) {
+        close(FileDescriptor);
+        return false;
+    }
+    void* View = mmap(nullptr, (size_t) FileStat.st_size, PROT_READ, MAP_PRIVATE, FileDescriptor, 0);
+    //mapping keeps file referenced, so descriptor is not needed anymore
+    close(FileDescriptor);
+    if (View == MAP_FAILED) {
+        return false;
+    }
+    Data = reinterpret_cast<const uint8_t*>(View);
+    Size = (size_t) FileStat.st_size;
+    return true;
+}
+
+void MappedFile::Close() {
+    if (Data != nullptr) {
+        munmap(const_cast<uint8_t*>(Data), Size);
+    }
+    Data = nullptr;
+    Size = 0;
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef XINPUT1_3_MAPPEDFILE_H
+#define XINPUT1_3_MAPPEDFILE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+
+/**
+ * Read-only memory mapping of the whole file
+ * Mapping is released when the object is destroyed or Close() is called
+ */
+class MappedFile {
+private:
+    void* FileHandle;
+    void* MappingHandle;
+    const uint8_t* Data;
+    size_t Size;
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /** Maps file at the given path into memory, closing previously mapped file. Returns false on failure */
+    bool Open(const std::filesystem::path& FilePath);
+    void Close();
+
+    inline bool IsOpen() const { return Data != nullptr; }
+    inline const uint8_t* GetData() const { return Data; }
+    inline size_t GetSize() const { return Size; }
+};
+
+#endif //XINPUT1_3_MAPPEDFILE_H
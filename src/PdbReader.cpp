@@ -0,0 +1,336 @@
+#include "PdbReader.h"
+#include <cstring>
+#include <algorithm>
+
+//"Microsoft C/C++ MSF 7.00\r\n\x1a" "DS\0\0\0" - MSF 7.0 superblock magic (big MSF format)
+static const char MsfFileMagic[32] = {
+    'M', 'i', 'c', 'r', 'o', 's', 'o', 'f', 't', ' ', 'C', '/', 'C', '+', '+', ' ',
+    'M', 'S', 'F', ' ', '7', '.', '0', '0', '\r', '\n', 0x1A, 'D', 'S', 0, 0, 0
+};
+
+struct MsfSuperBlock {
+    char FileMagic[32];
+    uint32_t BlockSize;
+    uint32_t FreeBlockMapBlock;
+    uint32_t NumBlocks;
+    uint32_t NumDirectoryBytes;
+    uint32_t Unknown;
+    uint32_t BlockMapAddr;
+};
+
+//Fixed stream indices
+#define PDB_INFO_STREAM_INDEX 1
+#define PDB_DBI_STREAM_INDEX 3
+#define PDB_NIL_STREAM_SIZE 0xFFFFFFFF
+#define PDB_INVALID_STREAM_INDEX 0xFFFF
+
+//DBI stream header layout, see DBIHdr in microsoft-pdb dbi.h
+#define DBI_HEADER_SIZE 64
+#define DBI_HEADER_AGE_OFFSET 8
+#define DBI_HEADER_GLOBAL_STREAM_OFFSET 12
+#define DBI_HEADER_PUBLIC_STREAM_OFFSET 16
+#define DBI_HEADER_SYMBOL_RECORD_STREAM_OFFSET 20
+#define DBI_HEADER_SUBSTREAM_SIZES_OFFSET 24
+//Index of the section header stream in the optional debug header stream list
+#define DBI_DEBUG_HEADER_SECTION_HEADER_INDEX 5
+
+//Publics stream starts with PSGSIHDR, followed by regular GSI hash table
+#define PUBLICS_STREAM_HEADER_SIZE 28
+#define GSI_HASH_SIGNATURE 0xFFFFFFFF
+#define GSI_HASH_VERSION (0xEFFE0000 + 19990810)
+
+//CodeView symbol record kinds we care about
+#define S_LDATA32 0x110C
+#define S_GDATA32 0x110D
+#define S_PUB32 0x110E
+
+#define CV_PUBLIC_FLAG_CODE 0x1
+#define CV_PUBLIC_FLAG_FUNCTION 0x2
+
+//Offset of name inside of S_PUB32/S_GDATA32/S_LDATA32 records, including record length and kind
+#define SYMBOL_RECORD_NAME_OFFSET 14
+#define SYMBOL_RECORD_OFFSET_OFFSET 8
+#define SYMBOL_RECORD_SEGMENT_OFFSET 12
+
+//IMAGE_SECTION_HEADER layout
+#define SECTION_HEADER_SIZE 40
+#define SECTION_HEADER_VIRTUAL_SIZE_OFFSET 8
+#define SECTION_HEADER_VIRTUAL_ADDRESS_OFFSET 12
+
+template<typename T>
+static bool ReadValue(const uint8_t* Data, size_t Size, size_t Offset, T& OutValue) {
+    if (Offset > Size || Size - Offset < sizeof(T)) {
+        return false;
+    }
+    memcpy(&OutValue, Data + Offset, sizeof(T));
+    return true;
+}
+
+PdbReader::PdbReader() : BlockSize(0), Signature{}, GlobalSymbolStreamIndex(PDB_INVALID_STREAM_INDEX),
+    PublicSymbolStreamIndex(PDB_INVALID_STREAM_INDEX), SymbolRecordStreamIndex(PDB_INVALID_STREAM_INDEX),
+    SectionHeaderStreamIndex(PDB_INVALID_STREAM_INDEX), bSymbolRecordsLoaded(false), bSectionsLoaded(false) {}
+
+bool PdbReader::Open(const std::filesystem::path& FilePath) {
+    if (!File.Open(FilePath)) {
+        return false;
+    }
+    MsfSuperBlock SuperBlock{};
+    if (!ReadValue(File.GetData(), File.GetSize(), 0, SuperBlock) ||
+        memcmp(SuperBlock.FileMagic, MsfFileMagic, sizeof(MsfFileMagic)) != 0) {
+        return false;
+    }
+    //block size is always one of 512, 1024, 2048 or 4096
+    if (SuperBlock.BlockSize < 512 || (SuperBlock.BlockSize & (SuperBlock.BlockSize - 1)) != 0 ||
+        (uint64_t) SuperBlock.NumBlocks * SuperBlock.BlockSize > File.GetSize()) {
+        return false;
+    }
+    BlockSize = SuperBlock.BlockSize;
+    if (!ReadStreamDirectory(SuperBlock.NumDirectoryBytes, SuperBlock.BlockMapAddr, SuperBlock.NumBlocks)) {
+        return false;
+    }
+    StreamData InfoStream;
+    if (!ReadStream(PDB_INFO_STREAM_INDEX, InfoStream) ||
+        !ReadValue(InfoStream.Data, InfoStream.Size, 12, Signature.Guid)) {
+        return false;
+    }
+    return ReadDbiStream();
+}
+
+bool PdbReader::ReadStreamDirectory(uint32_t DirectorySize, uint32_t BlockMapBlock, uint32_t BlockCount) {
+    const uint8_t* FileData = File.GetData();
+    const uint32_t DirectoryBlockCount = (DirectorySize + BlockSize - 1) / BlockSize;
+    if (BlockMapBlock >= BlockCount || (uint64_t) DirectoryBlockCount * sizeof(uint32_t) > BlockSize) {
+        return false;
+    }
+    //directory itself can be scattered across the file, so assemble it first
+    std::vector<uint8_t> Directory(DirectorySize);
+    const uint8_t* BlockMap = FileData + (size_t) BlockMapBlock * BlockSize;
+    for (uint32_t i = 0; i < DirectoryBlockCount; i++) {
+        uint32_t DirectoryBlock;
+        memcpy(&DirectoryBlock, BlockMap + i * sizeof(uint32_t), sizeof(uint32_t));
+        if (DirectoryBlock >= BlockCount) {
+            return false;
+        }
+        const size_t CopySize = std::min<size_t>(BlockSize, DirectorySize - (size_t) i * BlockSize);
+        memcpy(Directory.data() + (size_t) i * BlockSize, FileData + (size_t) DirectoryBlock * BlockSize, CopySize);
+    }
+    uint32_t StreamCount;
+    if (!ReadValue(Directory.data(), Directory.size(), 0, StreamCount) ||
+        (uint64_t) StreamCount * sizeof(uint32_t) > Directory.size()) {
+        return false;
+    }
+    StreamSizes.resize(StreamCount);
+    memcpy(StreamSizes.data(), Directory.data() + sizeof(uint32_t), StreamCount * sizeof(uint32_t));
+    size_t ReadOffset = sizeof(uint32_t) + StreamCount * sizeof(uint32_t);
+    StreamBlockOffsets.resize(StreamCount + 1);
+    StreamBlocks.clear();
+    for (uint32_t StreamIndex = 0; StreamIndex < StreamCount; StreamIndex++) {
+        if (StreamSizes[StreamIndex] == PDB_NIL_STREAM_SIZE) {
+            StreamSizes[StreamIndex] = 0;
+        }
+        StreamBlockOffsets[StreamIndex] = (uint32_t) StreamBlocks.size();
+        const uint32_t StreamBlockCount = (StreamSizes[StreamIndex] + BlockSize - 1) / BlockSize;
+        for (uint32_t i = 0; i < StreamBlockCount; i++) {
+            uint32_t StreamBlock;
+            if (!ReadValue(Directory.data(), Directory.size(), ReadOffset, StreamBlock) || StreamBlock >= BlockCount) {
+                return false;
+            }
+            StreamBlocks.push_back(StreamBlock);
+            ReadOffset += sizeof(uint32_t);
+        }
+    }
+    StreamBlockOffsets[StreamCount] = (uint32_t) StreamBlocks.size();
+    return true;
+}
+
+bool PdbReader::ReadStream(uint32_t StreamIndex, StreamData& OutData) const {
+    if (StreamIndex >= StreamSizes.size()) {
+        return false;
+    }
+    const uint32_t StreamSize = StreamSizes[StreamIndex];
+    const uint32_t* Blocks = StreamBlocks.data() + StreamBlockOffsets[StreamIndex];
+    const uint32_t BlockCount = StreamBlockOffsets[StreamIndex + 1] - StreamBlockOffsets[StreamIndex];
+    OutData.Storage.clear();
+    OutData.Size = StreamSize;
+    if (BlockCount == 0) {
+        OutData.Data = nullptr;
+        return true;
+    }
+    bool bContiguous = true;
+    for (uint32_t i = 1; i < BlockCount && bContiguous; i++) {
+        bContiguous = Blocks[i] == Blocks[i - 1] + 1;
+    }
+    if (bContiguous) {
+        OutData.Data = File.GetData() + (size_t) Blocks[0] * BlockSize;
+        return true;
+    }
+    OutData.Storage.resize(StreamSize);
+    for (uint32_t i = 0; i < BlockCount; i++) {
+        const size_t CopySize = std::min<size_t>(BlockSize, StreamSize - (size_t) i * BlockSize);
+        memcpy(OutData.Storage.data() + (size_t) i * BlockSize, File.GetData() + (size_t) Blocks[i] * BlockSize, CopySize);
+    }
+    OutData.Data = OutData.Storage.data();
+    return true;
+}
+
+bool PdbReader::ReadDbiStream() {
+    StreamData DbiStream;
+    if (!ReadStream(PDB_DBI_STREAM_INDEX, DbiStream) || DbiStream.Size < DBI_HEADER_SIZE) {
+        return false;
+    }
+    //age in DBI stream is the one written into the executable, info stream age may be newer
+    ReadValue(DbiStream.Data, DbiStream.Size, DBI_HEADER_AGE_OFFSET, Signature.Age);
+    ReadValue(DbiStream.Data, DbiStream.Size, DBI_HEADER_GLOBAL_STREAM_OFFSET, GlobalSymbolStreamIndex);
+    ReadValue(DbiStream.Data, DbiStream.Size, DBI_HEADER_PUBLIC_STREAM_OFFSET, PublicSymbolStreamIndex);
+    ReadValue(DbiStream.Data, DbiStream.Size, DBI_HEADER_SYMBOL_RECORD_STREAM_OFFSET, SymbolRecordStreamIndex);
+
+    //substream sizes in order: module info, section contributions, section map,
+    //source info, type server map, MFC type server index, optional debug header, EC
+    int32_t SubstreamSizes[8];
+    ReadValue(DbiStream.Data, DbiStream.Size, DBI_HEADER_SUBSTREAM_SIZES_OFFSET, SubstreamSizes);
+    int64_t DebugHeaderOffset = DBI_HEADER_SIZE;
+    const int SubstreamsBeforeDebugHeader[] = {0, 1, 2, 3, 4, 7};
+    for (int SubstreamIndex : SubstreamsBeforeDebugHeader) {
+        DebugHeaderOffset += SubstreamSizes[SubstreamIndex];
+    }
+    const int32_t DebugHeaderSize = SubstreamSizes[6];
+    const size_t SectionHeaderEntryOffset = DBI_DEBUG_HEADER_SECTION_HEADER_INDEX * sizeof(uint16_t);
+    if (DebugHeaderOffset >= 0 && DebugHeaderSize > 0 && (size_t) DebugHeaderSize > SectionHeaderEntryOffset) {
+        ReadValue(DbiStream.Data, DbiStream.Size, (size_t) DebugHeaderOffset + SectionHeaderEntryOffset, SectionHeaderStreamIndex);
+    }
+    return true;
+}
+
+void PdbReader::EnsureSymbolRecordsLoaded() {
+    if (!bSymbolRecordsLoaded) {
+        bSymbolRecordsLoaded = true;
+        if (!ReadStream(SymbolRecordStreamIndex, SymbolRecords)) {
+            SymbolRecords = StreamData{};
+        }
+    }
+}
+
+void PdbReader::EnsureSectionsLoaded() {
+    if (bSectionsLoaded) {
+        return;
+    }
+    bSectionsLoaded = true;
+    StreamData SectionHeaders;
+    if (!ReadStream(SectionHeaderStreamIndex, SectionHeaders)) {
+        return;
+    }
+    const size_t SectionCount = SectionHeaders.Size / SECTION_HEADER_SIZE;
+    Sections.resize(SectionCount);
+    for (size_t i = 0; i < SectionCount; i++) {
+        const size_t HeaderOffset = i * SECTION_HEADER_SIZE;
+        ReadValue(SectionHeaders.Data, SectionHeaders.Size, HeaderOffset + SECTION_HEADER_VIRTUAL_SIZE_OFFSET, Sections[i].VirtualSize);
+        ReadValue(SectionHeaders.Data, SectionHeaders.Size, HeaderOffset + SECTION_HEADER_VIRTUAL_ADDRESS_OFFSET, Sections[i].VirtualAddress);
+    }
+}
+
+bool PdbReader::SectionOffsetToRva(uint16_t SectionIndex, uint32_t Offset, uint32_t& OutRelativeVirtualAddress) {
+    EnsureSectionsLoaded();
+    if (SectionIndex == 0 || SectionIndex > Sections.size()) {
+        return false;
+    }
+    OutRelativeVirtualAddress = Sections[SectionIndex - 1].VirtualAddress + Offset;
+    return true;
+}
+
+void PdbReader::ForEachHashedSymbol(const StreamData& HashStream, size_t HashOffset, const std::function<void(const uint8_t* Record, uint16_t RecordKind, size_t RecordSize)>& Callback) {
+    uint32_t HashHeader[4];
+    if (!ReadValue(HashStream.Data, HashStream.Size, HashOffset, HashHeader) ||
+        HashHeader[0] != GSI_HASH_SIGNATURE || HashHeader[1] != GSI_HASH_VERSION) {
+        return;
+    }
+    EnsureSymbolRecordsLoaded();
+    //hash records follow the header, each is a pair of 1-based symbol record offset and reference count
+    const size_t HashRecordsOffset = HashOffset + sizeof(HashHeader);
+    const uint32_t HashRecordsSize = HashHeader[2];
+    for (size_t RecordOffset = 0; RecordOffset + 8 <= HashRecordsSize; RecordOffset += 8) {
+        int32_t SymbolOffset;
+        if (!ReadValue(HashStream.Data, HashStream.Size, HashRecordsOffset + RecordOffset, SymbolOffset) || SymbolOffset <= 0) {
+            break;
+        }
+        uint16_t RecordHeader[2];
+        const size_t SymbolRecordOffset = (size_t) SymbolOffset - 1;
+        if (!ReadValue(SymbolRecords.Data, SymbolRecords.Size, SymbolRecordOffset, RecordHeader)) {
+            continue;
+        }
+        //record length doesn't include the length field itself
+        const size_t RecordSize = (size_t) RecordHeader[0] + sizeof(uint16_t);
+        if (SymbolRecordOffset + RecordSize > SymbolRecords.Size) {
+            continue;
+        }
+        Callback(SymbolRecords.Data + SymbolRecordOffset, RecordHeader[1], RecordSize);
+    }
+}
+
+/** Parses S_PUB32/S_GDATA32/S_LDATA32 record, they all share the same offset/segment/name layout */
+static bool ParseAddressedSymbolRecord(const uint8_t* Record, size_t RecordSize, uint32_t& OutOffset, uint16_t& OutSegment, std::string_view& OutName) {
+    if (RecordSize <= SYMBOL_RECORD_NAME_OFFSET) {
+        return false;
+    }
+    memcpy(&OutOffset, Record + SYMBOL_RECORD_OFFSET_OFFSET, sizeof(OutOffset));
+    memcpy(&OutSegment, Record + SYMBOL_RECORD_SEGMENT_OFFSET, sizeof(OutSegment));
+    auto* Name = reinterpret_cast<const char*>(Record + SYMBOL_RECORD_NAME_OFFSET);
+    OutName = std::string_view(Name, strnlen(Name, RecordSize - SYMBOL_RECORD_NAME_OFFSET));
+    return !OutName.empty();
+}
+
+void PdbReader::ForEachPublicSymbol(const std::function<void(const PdbSymbol&)>& Callback) {
+    StreamData PublicStream;
+    if (!ReadStream(PublicSymbolStreamIndex, PublicStream)) {
+        return;
+    }
+    ForEachHashedSymbol(PublicStream, PUBLICS_STREAM_HEADER_SIZE, [&](const uint8_t* Record, uint16_t RecordKind, size_t RecordSize) {
+        uint32_t Offset;
+        uint16_t Segment;
+        PdbSymbol Symbol{};
+        if (RecordKind != S_PUB32 || !ParseAddressedSymbolRecord(Record, RecordSize, Offset, Segment, Symbol.Name) ||
+            !SectionOffsetToRva(Segment, Offset, Symbol.RelativeVirtualAddress)) {
+            return;
+        }
+        uint32_t PublicFlags;
+        memcpy(&PublicFlags, Record + 4, sizeof(PublicFlags));
+        if (PublicFlags & CV_PUBLIC_FLAG_CODE) {
+            Symbol.Flags |= PdbSymbolFlag_Code;
+        }
+        if (PublicFlags & CV_PUBLIC_FLAG_FUNCTION) {
+            Symbol.Flags |= PdbSymbolFlag_Function;
+        }
+        Callback(Symbol);
+    });
+}
+
+void PdbReader::ForEachGlobalSymbol(const std::function<void(const PdbSymbol&)>& Callback) {
+    StreamData GlobalStream;
+    if (!ReadStream(GlobalSymbolStreamIndex, GlobalStream)) {
+        return;
+    }
+    ForEachHashedSymbol(GlobalStream, 0, [&](const uint8_t* Record, uint16_t RecordKind, size_t RecordSize) {
+        uint32_t Offset;
+        uint16_t Segment;
+        PdbSymbol Symbol{};
+        if ((RecordKind != S_GDATA32 && RecordKind != S_LDATA32) ||
+            !ParseAddressedSymbolRecord(Record, RecordSize, Offset, Segment, Symbol.Name) ||
+            !SectionOffsetToRva(Segment, Offset, Symbol.RelativeVirtualAddress)) {
+            return;
+        }
+        Symbol.Flags = PdbSymbolFlag_Data;
+        Callback(Symbol);
+    });
+}
+
+void AddPdbSymbolsToIndex(PdbReader& Reader, SymbolIndexBuilder& IndexBuilder) {
+    Reader.ForEachPublicSymbol([&IndexBuilder](const PdbSymbol& Symbol) {
+        uint32_t Flags = SymbolFlag_HasAddress;
+        if (Symbol.Flags & PdbSymbolFlag_Function) {
+            Flags |= SymbolFlag_Function;
+        }
+        IndexBuilder.AddSymbol(std::string(Symbol.Name), std::string(), Symbol.RelativeVirtualAddress, Flags);
+    });
+    Reader.ForEachGlobalSymbol([&IndexBuilder](const PdbSymbol& Symbol) {
+        IndexBuilder.AddSymbol(std::string(Symbol.Name), std::string(), Symbol.RelativeVirtualAddress, SymbolFlag_HasAddress);
+    });
+}
@@ -0,0 +1,94 @@
+#ifndef XINPUT1_3_PDBREADER_H
+#define XINPUT1_3_PDBREADER_H
+
+#include <cstdint>
+#include <vector>
+#include <string_view>
+#include <functional>
+#include <filesystem>
+#include "MappedFile.h"
+#include "SymbolIndex.h"
+
+enum PdbSymbolFlags : uint32_t {
+    PdbSymbolFlag_Code = 0x1,
+    PdbSymbolFlag_Function = 0x2,
+    PdbSymbolFlag_Data = 0x4
+};
+
+struct PdbSymbol {
+    //Points directly into the symbol record, valid as long as PdbReader is alive
+    std::string_view Name;
+    uint32_t RelativeVirtualAddress;
+    uint32_t Flags;
+};
+
+/**
+ * Minimal reader of the MSF (multi-stream file) PDB format
+ * Only maps the file and parses stream directory on Open. Public symbols,
+ * global symbols and section headers are parsed lazily when first requested
+ * Doesn't depend on DIA or any other Windows API, so it can be used on any platform
+ */
+class PdbReader {
+private:
+    /** Stream contents. Points directly into the mapped file if stream blocks are contiguous, copied otherwise */
+    struct StreamData {
+        const uint8_t* Data = nullptr;
+        size_t Size = 0;
+        std::vector<uint8_t> Storage;
+    };
+    struct SectionRange {
+        uint32_t VirtualAddress;
+        uint32_t VirtualSize;
+    };
+    MappedFile File;
+    uint32_t BlockSize;
+    std::vector<uint32_t> StreamSizes;
+    //blocks of stream N are StreamBlocks[StreamBlockOffsets[N]..StreamBlockOffsets[N+1]]
+    std::vector<uint32_t> StreamBlocks;
+    std::vector<uint32_t> StreamBlockOffsets;
+    PdbSignature Signature;
+    uint16_t GlobalSymbolStreamIndex;
+    uint16_t PublicSymbolStreamIndex;
+    uint16_t SymbolRecordStreamIndex;
+    uint16_t SectionHeaderStreamIndex;
+
+    bool bSymbolRecordsLoaded;
+    StreamData SymbolRecords;
+    bool bSectionsLoaded;
+    std::vector<SectionRange> Sections;
+public:
+    PdbReader();
+
+    /** Maps PDB file and reads stream directory, returns false if file is missing or not a valid PDB */
+    bool Open(const std::filesystem::path& FilePath);
+
+    /** Signature of the PDB matching the one written into the CodeView record of the executable */
+    inline const PdbSignature& GetSignature() const { return Signature; }
+
+    /** Iterates S_PUB32 records referenced by the public symbol stream. Names are decorated */
+    void ForEachPublicSymbol(const std::function<void(const PdbSymbol&)>& Callback);
+
+    /**
+     * Iterates global and file-static data records referenced by the global symbol stream
+     * Procedure references are skipped since their addresses live in the module streams
+     */
+    void ForEachGlobalSymbol(const std::function<void(const PdbSymbol&)>& Callback);
+
+    /** Converts 1-based section index and offset into image relative virtual address */
+    bool SectionOffsetToRva(uint16_t SectionIndex, uint32_t Offset, uint32_t& OutRelativeVirtualAddress);
+private:
+    bool ReadStreamDirectory(uint32_t DirectorySize, uint32_t BlockMapBlock, uint32_t BlockCount);
+    bool ReadStream(uint32_t StreamIndex, StreamData& OutData) const;
+    bool ReadDbiStream();
+    void EnsureSymbolRecordsLoaded();
+    void EnsureSectionsLoaded();
+    void ForEachHashedSymbol(const StreamData& HashStream, size_t HashOffset, const std::function<void(const uint8_t* Record, uint16_t RecordKind, size_t RecordSize)>& Callback);
+};
+
+/**
+ * Adds public symbols and global data of the PDB into the symbol index
+ * Public symbols are added under their decorated names, without undecorated names
+ */
+void AddPdbSymbolsToIndex(PdbReader& Reader, SymbolIndexBuilder& IndexBuilder);
+
+#endif //XINPUT1_3_PDBREADER_H
@@ -0,0 +1,375 @@
+#include "PeImage.h"
+#include <cstring>
+
+#define PE_DOS_SIGNATURE 0x5A4D //MZ
+#define PE_NT_SIGNATURE 0x00004550 //PE\0\0
+#define PE_DOS_LFANEW_OFFSET 0x3C
+#define PE_OPTIONAL_HEADER_MAGIC_PE32 0x10B
+#define PE_OPTIONAL_HEADER_MAGIC_PE32_PLUS 0x20B
+
+//Offsets inside of NT headers (signature + IMAGE_FILE_HEADER + optional header)
+#define PE_FILE_HEADER_OFFSET 4
+#define PE_FILE_HEADER_SIZE 20
+#define PE_OPTIONAL_HEADER_OFFSET (PE_FILE_HEADER_OFFSET + PE_FILE_HEADER_SIZE)
+#define PE_OPTIONAL_ENTRY_POINT_OFFSET 16
+#define PE_OPTIONAL_IMAGE_BASE_OFFSET_PE32 28
+#define PE_OPTIONAL_IMAGE_BASE_OFFSET_PE32_PLUS 24
+#define PE_OPTIONAL_SIZE_OF_IMAGE_OFFSET 56
+#define PE_OPTIONAL_SIZE_OF_HEADERS_OFFSET 60
+#define PE_OPTIONAL_DIRECTORY_COUNT_OFFSET_PE32 92
+#define PE_OPTIONAL_DIRECTORY_COUNT_OFFSET_PE32_PLUS 108
+
+#define PE_SECTION_HEADER_SIZE 40
+#define PE_IMPORT_DESCRIPTOR_SIZE 20
+#define PE_EXPORT_DIRECTORY_SIZE 40
+#define PE_DEBUG_DIRECTORY_SIZE 28
+#define PE_DEBUG_TYPE_CODEVIEW 2
+#define PE_CODEVIEW_PDB70_SIGNATURE 0x53445352 //'RSDS'
+#define PE_CODEVIEW_PDB70_HEADER_SIZE 24
+#define PE_ORDINAL_FLAG_PE32 0x80000000ull
+#define PE_ORDINAL_FLAG_PE32_PLUS 0x8000000000000000ull
+
+template<typename T>
+static bool ReadValue(const uint8_t* Data, size_t Size, size_t Offset, T& OutValue) {
+    if (Offset > Size || Size - Offset < sizeof(T)) {
+        return false;
+    }
+    memcpy(&OutValue, Data + Offset, sizeof(T));
+    return true;
+}
+
+PeImage::PeImage() : Data(nullptr), Size(0), Layout(PeImageLayout::Mapped), bIs64Bit(false), Machine(0), ImageBase(0),
+    SizeOfImage(0), AddressOfEntryPoint(0), SizeOfHeaders(0), DataDirectoryCount(0), DataDirectoryOffset(0),
+    SectionTableOffset(0), SectionCount(0) {}
+
+bool PeImage::Open(const uint8_t* ImageData, size_t ImageSize, PeImageLayout ImageLayout) {
+    Data = ImageData;
+    Size = ImageSize;
+    Layout = ImageLayout;
+    if (!ParseHeaders()) {
+        Data = nullptr;
+        Size = 0;
+        return false;
+    }
+    return true;
+}
+
+bool PeImage::OpenLoadedImage(const void* ImageBaseAddress) {
+    //headers of the loaded image are always mapped, so it is safe to read them to figure out image size
+    const auto* BaseAddress = reinterpret_cast<const uint8_t*>(ImageBaseAddress);
+    uint16_t DosSignature;
+    uint32_t NtHeaderOffset;
+    uint32_t LoadedImageSize;
+    memcpy(&DosSignature, BaseAddress, sizeof(DosSignature));
+    if (DosSignature != PE_DOS_SIGNATURE) {
+        return false;
+    }
+    memcpy(&NtHeaderOffset, BaseAddress + PE_DOS_LFANEW_OFFSET, sizeof(NtHeaderOffset));
+    memcpy(&LoadedImageSize, BaseAddress + NtHeaderOffset + PE_OPTIONAL_HEADER_OFFSET + PE_OPTIONAL_SIZE_OF_IMAGE_OFFSET, sizeof(LoadedImageSize));
+    return Open(BaseAddress, LoadedImageSize, PeImageLayout::Mapped);
+}
+
+bool PeImage::ParseHeaders() {
+    uint16_t DosSignature;
+    uint32_t NtHeaderOffset;
+    uint32_t NtSignature;
+    if (!ReadValue(Data, Size, 0, DosSignature) || DosSignature != PE_DOS_SIGNATURE ||
+        !ReadValue(Data, Size, PE_DOS_LFANEW_OFFSET, NtHeaderOffset) ||
+        !ReadValue(Data, Size, NtHeaderOffset, NtSignature) || NtSignature != PE_NT_SIGNATURE) {
+        return false;
+    }
+    const size_t FileHeaderOffset = (size_t) NtHeaderOffset + PE_FILE_HEADER_OFFSET;
+    const size_t OptionalHeaderOffset = (size_t) NtHeaderOffset + PE_OPTIONAL_HEADER_OFFSET;
+    uint16_t OptionalHeaderSize;
+    uint16_t OptionalHeaderMagic;
+    if (!ReadValue(Data, Size, FileHeaderOffset, Machine) ||
+        !ReadValue(Data, Size, FileHeaderOffset + 2, SectionCount) ||
+        !ReadValue(Data, Size, FileHeaderOffset + 16, OptionalHeaderSize) ||
+        !ReadValue(Data, Size, OptionalHeaderOffset, OptionalHeaderMagic)) {
+        return false;
+    }
+    if (OptionalHeaderMagic != PE_OPTIONAL_HEADER_MAGIC_PE32 && OptionalHeaderMagic != PE_OPTIONAL_HEADER_MAGIC_PE32_PLUS) {
+        return false;
+    }
+    bIs64Bit = OptionalHeaderMagic == PE_OPTIONAL_HEADER_MAGIC_PE32_PLUS;
+    bool bHeadersValid = ReadValue(Data, Size, OptionalHeaderOffset + PE_OPTIONAL_ENTRY_POINT_OFFSET, AddressOfEntryPoint) &&
+        ReadValue(Data, Size, OptionalHeaderOffset + PE_OPTIONAL_SIZE_OF_IMAGE_OFFSET, SizeOfImage) &&
+        ReadValue(Data, Size, OptionalHeaderOffset + PE_OPTIONAL_SIZE_OF_HEADERS_OFFSET, SizeOfHeaders);
+    size_t DirectoryCountOffset;
+    if (bIs64Bit) {
+        bHeadersValid &= ReadValue(Data, Size, OptionalHeaderOffset + PE_OPTIONAL_IMAGE_BASE_OFFSET_PE32_PLUS, ImageBase);
+        DirectoryCountOffset = PE_OPTIONAL_DIRECTORY_COUNT_OFFSET_PE32_PLUS;
+    } else {
+        uint32_t ImageBase32 = 0;
+        bHeadersValid &= ReadValue(Data, Size, OptionalHeaderOffset + PE_OPTIONAL_IMAGE_BASE_OFFSET_PE32, ImageBase32);
+        ImageBase = ImageBase32;
+        DirectoryCountOffset = PE_OPTIONAL_DIRECTORY_COUNT_OFFSET_PE32;
+    }
+    bHeadersValid &= ReadValue(Data, Size, OptionalHeaderOffset + DirectoryCountOffset, DataDirectoryCount);
+    if (!bHeadersValid) {
+        return false;
+    }
+    DataDirectoryOffset = OptionalHeaderOffset + DirectoryCountOffset + sizeof(uint32_t);
+    //directories past the end of the optional header don't exist, regardless of what the count says
+    const size_t DirectorySpace = OptionalHeaderSize > DirectoryCountOffset + sizeof(uint32_t) ? OptionalHeaderSize - DirectoryCountOffset - sizeof(uint32_t) : 0;
+    if (DataDirectoryCount > DirectorySpace / sizeof(PeDataDirectory)) {
+        DataDirectoryCount = (uint32_t) (DirectorySpace / sizeof(PeDataDirectory));
+    }
+    SectionTableOffset = OptionalHeaderOffset + OptionalHeaderSize;
+    return SectionTableOffset <= Size && (Size - SectionTableOffset) / PE_SECTION_HEADER_SIZE >= SectionCount;
+}
+
+uint32_t PeImage::ReadUInt32(const uint8_t* Pointer) {
+    uint32_t Value;
+    memcpy(&Value, Pointer, sizeof(Value));
+    return Value;
+}
+
+uint64_t PeImage::ReadUInt64(const uint8_t* Pointer) {
+    uint64_t Value;
+    memcpy(&Value, Pointer, sizeof(Value));
+    return Value;
+}
+
+bool PeImage::GetSection(uint16_t SectionIndex, PeSectionHeader& OutSection) const {
+    if (SectionIndex >= SectionCount) {
+        return false;
+    }
+    return ReadValue(Data, Size, SectionTableOffset + (size_t) SectionIndex * PE_SECTION_HEADER_SIZE, OutSection);
+}
+
+bool PeImage::FindSection(uint32_t Rva, PeSectionHeader& OutSection) const {
+    for (uint16_t i = 0; i < SectionCount; i++) {
+        if (!GetSection(i, OutSection)) {
+            return false;
+        }
+        const uint32_t SectionSize = OutSection.VirtualSize != 0 ? OutSection.VirtualSize : OutSection.SizeOfRawData;
+        if (Rva >= OutSection.VirtualAddress && Rva - OutSection.VirtualAddress < SectionSize) {
+            return true;
+        }
+    }
+    return false;
+}
+
+PeDataDirectory PeImage::GetDataDirectory(uint32_t DirectoryIndex) const {
+    PeDataDirectory Directory{};
+    if (DirectoryIndex >= DataDirectoryCount ||
+        !ReadValue(Data, Size, DataDirectoryOffset + DirectoryIndex * sizeof(PeDataDirectory), Directory)) {
+        return PeDataDirectory{};
+    }
+    return Directory;
+}
+
+const uint8_t* PeImage::TranslateRva(uint32_t Rva, size_t& OutAvailableSize) const {
+    size_t Offset;
+    size_t RegionEnd = Size;
+    if (Layout == PeImageLayout::Mapped || Rva < SizeOfHeaders) {
+        Offset = Rva;
+    } else {
+        PeSectionHeader Section{};
+        if (!FindSection(Rva, Section)) {
+            return nullptr;
+        }
+        //parts of the section past its raw data are zero-filled by the loader and don't exist in the file
+        const uint32_t SectionOffset = Rva - Section.VirtualAddress;
+        if (SectionOffset >= Section.SizeOfRawData) {
+            return nullptr;
+        }
+        Offset = (size_t) Section.PointerToRawData + SectionOffset;
+        RegionEnd = (size_t) Section.PointerToRawData + Section.SizeOfRawData;
+        if (RegionEnd > Size) RegionEnd = Size;
+    }
+    if (Offset >= RegionEnd) {
+        return nullptr;
+    }
+    OutAvailableSize = RegionEnd - Offset;
+    return Data + Offset;
+}
+
+const uint8_t* PeImage::RvaToPointer(uint32_t Rva, size_t RangeSize) const {
+    size_t AvailableSize = 0;
+    const uint8_t* Pointer = TranslateRva(Rva, AvailableSize);
+    return Pointer != nullptr && AvailableSize >= RangeSize ? Pointer : nullptr;
+}
+
+std::string_view PeImage::GetStringAtRva(uint32_t Rva) const {
+    size_t AvailableSize = 0;
+    const char* String = reinterpret_cast<const char*>(TranslateRva(Rva, AvailableSize));
+    if (String == nullptr) {
+        return std::string_view();
+    }
+    const void* Terminator = memchr(String, '\0', AvailableSize);
+    if (Terminator == nullptr) {
+        return std::string_view();
+    }
+    return std::string_view(String, reinterpret_cast<const char*>(Terminator) - String);
+}
+
+PeReadResult PeImage::GetImportDescriptor(uint32_t DescriptorIndex, PeImportDescriptor& OutDescriptor) const {
+    const PeDataDirectory Directory = GetDataDirectory(PeDirectory_Import);
+    if (Directory.VirtualAddress == 0) {
+        return PeReadResult::End;
+    }
+    //directory size is not reliable, so descriptors are read until the null terminator one
+    const uint8_t* Descriptor = RvaToPointer(Directory.VirtualAddress + DescriptorIndex * PE_IMPORT_DESCRIPTOR_SIZE, PE_IMPORT_DESCRIPTOR_SIZE);
+    if (Descriptor == nullptr) {
+        return PeReadResult::Invalid;
+    }
+    const uint32_t LookupTableRva = ReadUInt32(Descriptor);
+    const uint32_t NameRva = ReadUInt32(Descriptor + 12);
+    const uint32_t AddressTableRva = ReadUInt32(Descriptor + 16);
+    if (NameRva == 0) {
+        return PeReadResult::End;
+    }
+    OutDescriptor.LibraryName = GetStringAtRva(NameRva);
+    //lookup table is optional, address table contains import descriptions then
+    OutDescriptor.LookupTableRva = LookupTableRva != 0 ? LookupTableRva : AddressTableRva;
+    OutDescriptor.AddressTableRva = AddressTableRva;
+    return OutDescriptor.LibraryName.empty() ? PeReadResult::Invalid : PeReadResult::Success;
+}
+
+PeReadResult PeImage::GetImport(const PeImportDescriptor& Descriptor, uint32_t ImportIndex, PeImport& OutImport) const {
+    const uint32_t ThunkSize = bIs64Bit ? 8 : 4;
+    const uint8_t* Thunk = RvaToPointer(Descriptor.LookupTableRva + ImportIndex * ThunkSize, ThunkSize);
+    if (Thunk == nullptr) {
+        return PeReadResult::Invalid;
+    }
+    const uint64_t ThunkValue = bIs64Bit ? ReadUInt64(Thunk) : ReadUInt32(Thunk);
+    if (ThunkValue == 0) {
+        return PeReadResult::End;
+    }
+    OutImport.AddressSlotRva = Descriptor.AddressTableRva + ImportIndex * ThunkSize;
+    OutImport.bByOrdinal = (ThunkValue & (bIs64Bit ? PE_ORDINAL_FLAG_PE32_PLUS : PE_ORDINAL_FLAG_PE32)) != 0;
+    if (OutImport.bByOrdinal) {
+        OutImport.Ordinal = (uint16_t) (ThunkValue & 0xFFFF);
+        OutImport.Hint = 0;
+        OutImport.Name = std::string_view();
+        return PeReadResult::Success;
+    }
+    //IMAGE_IMPORT_BY_NAME: 2 byte hint followed by the name
+    const uint32_t ImportByNameRva = (uint32_t) (ThunkValue & 0x7FFFFFFF);
+    const uint8_t* HintPointer = RvaToPointer(ImportByNameRva, sizeof(uint16_t));
+    if (HintPointer == nullptr) {
+        return PeReadResult::Invalid;
+    }
+    OutImport.Ordinal = 0;
+    OutImport.Hint = (uint16_t) (HintPointer[0] | (HintPointer[1] << 8));
+    OutImport.Name = GetStringAtRva(ImportByNameRva + sizeof(uint16_t));
+    return OutImport.Name.empty() ? PeReadResult::Invalid : PeReadResult::Success;
+}
+
+uint32_t PeImage::GetExportCount() const {
+    const PeDataDirectory Directory = GetDataDirectory(PeDirectory_Export);
+    const uint8_t* ExportDirectory = Directory.VirtualAddress ? RvaToPointer(Directory.VirtualAddress, PE_EXPORT_DIRECTORY_SIZE) : nullptr;
+    return ExportDirectory != nullptr ? ReadUInt32(ExportDirectory + 24) : 0;
+}
+
+bool PeImage::GetExport(uint32_t ExportIndex, PeExport& OutExport) const {
+    const PeDataDirectory Directory = GetDataDirectory(PeDirectory_Export);
+    const uint8_t* ExportDirectory = Directory.VirtualAddress ? RvaToPointer(Directory.VirtualAddress, PE_EXPORT_DIRECTORY_SIZE) : nullptr;
+    if (ExportDirectory == nullptr || ExportIndex >= ReadUInt32(ExportDirectory + 24)) {
+        return false;
+    }
+    const uint32_t OrdinalBase = ReadUInt32(ExportDirectory + 16);
+    const uint32_t FunctionCount = ReadUInt32(ExportDirectory + 20);
+    const uint32_t FunctionTableRva = ReadUInt32(ExportDirectory + 28);
+    const uint32_t NameTableRva = ReadUInt32(ExportDirectory + 32);
+    const uint32_t OrdinalTableRva = ReadUInt32(ExportDirectory + 36);
+
+    const uint8_t* NameRvaPointer = RvaToPointer(NameTableRva + ExportIndex * sizeof(uint32_t), sizeof(uint32_t));
+    const uint8_t* OrdinalPointer = RvaToPointer(OrdinalTableRva + ExportIndex * sizeof(uint16_t), sizeof(uint16_t));
+    if (NameRvaPointer == nullptr || OrdinalPointer == nullptr) {
+        return false;
+    }
+    const uint16_t FunctionIndex = (uint16_t) (OrdinalPointer[0] | (OrdinalPointer[1] << 8));
+    const uint8_t* FunctionRvaPointer = FunctionIndex < FunctionCount ? RvaToPointer(FunctionTableRva + FunctionIndex * sizeof(uint32_t), sizeof(uint32_t)) : nullptr;
+    if (FunctionRvaPointer == nullptr) {
+        return false;
+    }
+    const uint32_t FunctionRva = ReadUInt32(FunctionRvaPointer);
+    OutExport.Name = GetStringAtRva(ReadUInt32(NameRvaPointer));
+    OutExport.Ordinal = OrdinalBase + FunctionIndex;
+    //exports pointing inside of the export directory are forwarder strings
+    if (FunctionRva >= Directory.VirtualAddress && FunctionRva - Directory.VirtualAddress < Directory.Size) {
+        OutExport.Rva = 0;
+        OutExport.Forwarder = GetStringAtRva(FunctionRva);
+    } else {
+        OutExport.Rva = FunctionRva;
+        OutExport.Forwarder = std::string_view();
+    }
+    return !OutExport.Name.empty();
+}
+
+bool PeImage::FindExport(std::string_view ExportName, PeExport& OutExport) const {
+    uint32_t RangeStart = 0;
+    uint32_t RangeEnd = GetExportCount();
+    while (RangeStart < RangeEnd) {
+        const uint32_t Middle = RangeStart + (RangeEnd - RangeStart) / 2;
+        if (!GetExport(Middle, OutExport)) {
+            return false;
+        }
+        const int Comparison = OutExport.Name.compare(ExportName);
+        if (Comparison == 0) {
+            return true;
+        }
+        if (Comparison < 0) {
+            RangeStart = Middle + 1;
+        } else {
+            RangeEnd = Middle;
+        }
+    }
+    return false;
+}
+
+bool PeImage::GetTlsInfo(PeTlsInfo& OutTlsInfo) const {
+    const PeDataDirectory Directory = GetDataDirectory(PeDirectory_Tls);
+    if (Directory.VirtualAddress == 0) {
+        return false;
+    }
+    if (bIs64Bit) {
+        const uint8_t* TlsDirectory = RvaToPointer(Directory.VirtualAddress, 40);
+        if (TlsDirectory == nullptr) return false;
+        OutTlsInfo.StartAddressOfRawData = ReadUInt64(TlsDirectory);
+        OutTlsInfo.EndAddressOfRawData = ReadUInt64(TlsDirectory + 8);
+        OutTlsInfo.AddressOfIndex = ReadUInt64(TlsDirectory + 16);
+        OutTlsInfo.AddressOfCallBacks = ReadUInt64(TlsDirectory + 24);
+        OutTlsInfo.SizeOfZeroFill = ReadUInt32(TlsDirectory + 32);
+        OutTlsInfo.Characteristics = ReadUInt32(TlsDirectory + 36);
+    } else {
+        const uint8_t* TlsDirectory = RvaToPointer(Directory.VirtualAddress, 24);
+        if (TlsDirectory == nullptr) return false;
+        OutTlsInfo.StartAddressOfRawData = ReadUInt32(TlsDirectory);
+        OutTlsInfo.EndAddressOfRawData = ReadUInt32(TlsDirectory + 4);
+        OutTlsInfo.AddressOfIndex = ReadUInt32(TlsDirectory + 8);
+        OutTlsInfo.AddressOfCallBacks = ReadUInt32(TlsDirectory + 12);
+        OutTlsInfo.SizeOfZeroFill = ReadUInt32(TlsDirectory + 16);
+        OutTlsInfo.Characteristics = ReadUInt32(TlsDirectory + 20);
+    }
+    return true;
+}
+
+bool PeImage::GetCodeViewInfo(PeCodeViewInfo& OutCodeViewInfo) const {
+    const PeDataDirectory Directory = GetDataDirectory(PeDirectory_Debug);
+    for (uint32_t Offset = 0; Offset + PE_DEBUG_DIRECTORY_SIZE <= Directory.Size; Offset += PE_DEBUG_DIRECTORY_SIZE) {
+        const uint8_t* DebugEntry = RvaToPointer(Directory.VirtualAddress + Offset, PE_DEBUG_DIRECTORY_SIZE);
+        if (DebugEntry == nullptr) return false;
+        const uint32_t Type = ReadUInt32(DebugEntry + 12);
+        const uint32_t SizeOfData = ReadUInt32(DebugEntry + 16);
+        const uint32_t AddressOfRawData = ReadUInt32(DebugEntry + 20);
+        if (Type != PE_DEBUG_TYPE_CODEVIEW || AddressOfRawData == 0 || SizeOfData < PE_CODEVIEW_PDB70_HEADER_SIZE) {
+            continue;
+        }
+        const uint8_t* CodeViewRecord = RvaToPointer(AddressOfRawData, SizeOfData);
+        if (CodeViewRecord == nullptr || ReadUInt32(CodeViewRecord) != PE_CODEVIEW_PDB70_SIGNATURE) {
+            continue;
+        }
+        memcpy(OutCodeViewInfo.Guid, CodeViewRecord + 4, sizeof(OutCodeViewInfo.Guid));
+        OutCodeViewInfo.Age = ReadUInt32(CodeViewRecord + 20);
+        //file name is null terminated, but don't trust it to be
+        const char* PdbPath = reinterpret_cast<const char*>(CodeViewRecord + PE_CODEVIEW_PDB70_HEADER_SIZE);
+        const size_t MaxPathLength = SizeOfData - PE_CODEVIEW_PDB70_HEADER_SIZE;
+        OutCodeViewInfo.PdbPath = std::string_view(PdbPath, strnlen(PdbPath, MaxPathLength));
+        return true;
+    }
+    return false;
+}
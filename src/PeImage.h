@@ -0,0 +1,248 @@
+#ifndef XINPUT1_3_PEIMAGE_H
+#define XINPUT1_3_PEIMAGE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+enum class PeImageLayout {
+    /** Image mapped into memory by the OS loader, relative virtual addresses are offsets into the data */
+    Mapped,
+    /** Raw file contents, relative virtual addresses are translated through the section table */
+    File
+};
+
+enum class PeReadResult {
+    Success,
+    /** Reached the end of the table */
+    End,
+    /** Table is malformed or points outside of the image */
+    Invalid
+};
+
+enum PeDirectoryIndex : uint32_t {
+    PeDirectory_Export = 0,
+    PeDirectory_Import = 1,
+    PeDirectory_BaseRelocation = 5,
+    PeDirectory_Debug = 6,
+    PeDirectory_Tls = 9,
+    PeDirectory_ImportAddressTable = 12,
+    PeDirectory_DelayImport = 13
+};
+
+struct PeDataDirectory {
+    uint32_t VirtualAddress;
+    uint32_t Size;
+};
+
+/** Same layout as IMAGE_SECTION_HEADER */
+struct PeSectionHeader {
+    char Name[8];
+    uint32_t VirtualSize;
+    uint32_t VirtualAddress;
+    uint32_t SizeOfRawData;
+    uint32_t PointerToRawData;
+    uint32_t PointerToRelocations;
+    uint32_t PointerToLinenumbers;
+    uint16_t NumberOfRelocations;
+    uint16_t NumberOfLinenumbers;
+    uint32_t Characteristics;
+};
+
+#define PE_SECTION_EXECUTABLE 0x20000000
+
+struct PeImportDescriptor {
+    std::string_view LibraryName;
+    uint32_t LookupTableRva;
+    uint32_t AddressTableRva;
+};
+
+struct PeImport {
+    /** Empty for imports by ordinal. Points into the image and is null terminated */
+    std::string_view Name;
+    uint16_t Hint;
+    uint16_t Ordinal;
+    bool bByOrdinal;
+    /** Relative virtual address of the IAT slot receiving address of the import */
+    uint32_t AddressSlotRva;
+};
+
+struct PeExport {
+    std::string_view Name;
+    uint32_t Ordinal;
+    /** Zero for forwarded exports */
+    uint32_t Rva;
+    /** "Library.Symbol" or "Library.#Ordinal" for forwarded exports, empty otherwise */
+    std::string_view Forwarder;
+};
+
+struct PeRelocation {
+    uint32_t Rva;
+    uint8_t Type;
+};
+
+/** RSDS CodeView record identifying PDB of the image */
+struct PeCodeViewInfo {
+    uint8_t Guid[16];
+    uint32_t Age;
+    /** Path to the PDB recorded by the linker, points into the image */
+    std::string_view PdbPath;
+};
+
+struct PeTlsInfo {
+    uint64_t StartAddressOfRawData;
+    uint64_t EndAddressOfRawData;
+    uint64_t AddressOfIndex;
+    uint64_t AddressOfCallBacks;
+    uint32_t SizeOfZeroFill;
+    uint32_t Characteristics;
+};
+
+/**
+ * Bounds-checked PE32/PE32+ image parser working on top of the existing memory,
+ * either an image mapped by the OS loader or a raw file mapping
+ * Never allocates, all returned names point directly into the image data
+ * Iteration functions take a callback returning true to continue iteration,
+ * and return false if the image is malformed or the callback stopped the iteration
+ */
+class PeImage {
+private:
+    const uint8_t* Data;
+    size_t Size;
+    PeImageLayout Layout;
+    bool bIs64Bit;
+    uint16_t Machine;
+    uint64_t ImageBase;
+    uint32_t SizeOfImage;
+    uint32_t AddressOfEntryPoint;
+    uint32_t SizeOfHeaders;
+    uint32_t DataDirectoryCount;
+    size_t DataDirectoryOffset;
+    size_t SectionTableOffset;
+    uint16_t SectionCount;
+public:
+    PeImage();
+
+    /** Parses headers of the image, returns false if it is not a valid PE image */
+    bool Open(const uint8_t* ImageData, size_t ImageSize, PeImageLayout ImageLayout);
+
+    /** Parses headers of the image mapped by the OS loader, taking image size from its headers */
+    bool OpenLoadedImage(const void* ImageBaseAddress);
+
+    inline const uint8_t* GetData() const { return Data; }
+    inline bool Is64Bit() const { return bIs64Bit; }
+    inline uint16_t GetMachine() const { return Machine; }
+    inline uint64_t GetImageBase() const { return ImageBase; }
+    inline uint32_t GetSizeOfImage() const { return SizeOfImage; }
+    inline uint32_t GetAddressOfEntryPoint() const { return AddressOfEntryPoint; }
+    inline uint16_t GetSectionCount() const { return SectionCount; }
+    inline uint32_t GetSizeOfHeaders() const { return SizeOfHeaders; }
+
+    /** Reads section header by its zero-based index */
+    bool GetSection(uint16_t SectionIndex, PeSectionHeader& OutSection) const;
+    /** Finds section containing given relative virtual address */
+    bool FindSection(uint32_t Rva, PeSectionHeader& OutSection) const;
+    /** Returns empty directory if it's absent */
+    PeDataDirectory GetDataDirectory(uint32_t DirectoryIndex) const;
+
+    /** Translates relative virtual address into the pointer, returns nullptr if requested range is outside of the image */
+    const uint8_t* RvaToPointer(uint32_t Rva, size_t RangeSize) const;
+    /** Returns null terminated string at the given address, or empty string if it is not terminated inside of the image */
+    std::string_view GetStringAtRva(uint32_t Rva) const;
+
+    PeReadResult GetImportDescriptor(uint32_t DescriptorIndex, PeImportDescriptor& OutDescriptor) const;
+    PeReadResult GetImport(const PeImportDescriptor& Descriptor, uint32_t ImportIndex, PeImport& OutImport) const;
+
+    uint32_t GetExportCount() const;
+    /** Reads named export with the given index, in the order of the export name table (sorted by name) */
+    bool GetExport(uint32_t ExportIndex, PeExport& OutExport) const;
+    /** Binary searches export name table for the given name */
+    bool FindExport(std::string_view ExportName, PeExport& OutExport) const;
+
+    bool GetTlsInfo(PeTlsInfo& OutTlsInfo) const;
+    /** Finds RSDS CodeView record in the debug directory, returns false if image doesn't reference a PDB */
+    bool GetCodeViewInfo(PeCodeViewInfo& OutCodeViewInfo) const;
+
+    template<typename Callback>
+    bool ForEachImportDescriptor(Callback&& Function) const {
+        PeImportDescriptor Descriptor{};
+        PeReadResult Result;
+        for (uint32_t i = 0; (Result = GetImportDescriptor(i, Descriptor)) == PeReadResult::Success; i++) {
+            if (!Function(Descriptor)) return false;
+        }
+        return Result == PeReadResult::End;
+    }
+
+    template<typename Callback>
+    bool ForEachImport(const PeImportDescriptor& Descriptor, Callback&& Function) const {
+        PeImport Import{};
+        PeReadResult Result;
+        for (uint32_t i = 0; (Result = GetImport(Descriptor, i, Import)) == PeReadResult::Success; i++) {
+            if (!Function(Import)) return false;
+        }
+        return Result == PeReadResult::End;
+    }
+
+    template<typename Callback>
+    bool ForEachExport(Callback&& Function) const {
+        PeExport Export{};
+        const uint32_t ExportCount = GetExportCount();
+        for (uint32_t i = 0; i < ExportCount; i++) {
+            if (!GetExport(i, Export) || !Function(Export)) return false;
+        }
+        return true;
+    }
+
+    /** Iterates base relocation entries, skipping padding entries */
+    template<typename Callback>
+    bool ForEachRelocation(Callback&& Function) const {
+        const PeDataDirectory Directory = GetDataDirectory(PeDirectory_BaseRelocation);
+        uint32_t BlockOffset = 0;
+        while (BlockOffset + 8 <= Directory.Size) {
+            const uint8_t* Block = RvaToPointer(Directory.VirtualAddress + BlockOffset, 8);
+            if (Block == nullptr) return false;
+            const uint32_t PageRva = ReadUInt32(Block);
+            const uint32_t BlockSize = ReadUInt32(Block + 4);
+            if (BlockSize < 8 || BlockSize > Directory.Size - BlockOffset) return false;
+            const uint8_t* Entries = RvaToPointer(Directory.VirtualAddress + BlockOffset + 8, BlockSize - 8);
+            if (Entries == nullptr) return false;
+            for (uint32_t i = 0; i + 2 <= BlockSize - 8; i += 2) {
+                const uint16_t Entry = (uint16_t) (Entries[i] | (Entries[i + 1] << 8));
+                //IMAGE_REL_BASED_ABSOLUTE entries only pad blocks to 4 bytes
+                if ((Entry >> 12) != 0 && !Function(PeRelocation{PageRva + (Entry & 0xFFF), (uint8_t) (Entry >> 12)})) {
+                    return false;
+                }
+            }
+            BlockOffset += BlockSize;
+        }
+        return true;
+    }
+
+    /** Iterates virtual addresses of TLS callbacks, as they are written into the image */
+    template<typename Callback>
+    bool ForEachTlsCallback(Callback&& Function) const {
+        PeTlsInfo TlsInfo{};
+        if (!GetTlsInfo(TlsInfo) || TlsInfo.AddressOfCallBacks == 0) {
+            return true;
+        }
+        if (TlsInfo.AddressOfCallBacks < ImageBase) return false;
+        const size_t PointerSize = bIs64Bit ? 8 : 4;
+        uint32_t CallbackRva = (uint32_t) (TlsInfo.AddressOfCallBacks - ImageBase);
+        while (true) {
+            const uint8_t* CallbackPointer = RvaToPointer(CallbackRva, PointerSize);
+            if (CallbackPointer == nullptr) return false;
+            const uint64_t CallbackAddress = bIs64Bit ? ReadUInt64(CallbackPointer) : ReadUInt32(CallbackPointer);
+            if (CallbackAddress == 0) return true;
+            if (!Function(CallbackAddress)) return false;
+            CallbackRva += (uint32_t) PointerSize;
+        }
+    }
+private:
+    bool ParseHeaders();
+    /** Translates relative virtual address into the pointer, also returning amount of bytes readable after it */
+    const uint8_t* TranslateRva(uint32_t Rva, size_t& OutAvailableSize) const;
+    static uint32_t ReadUInt32(const uint8_t* Pointer);
+    static uint64_t ReadUInt64(const uint8_t* Pointer);
+};
+
+#endif //XINPUT1_3_PEIMAGE_H
@@ -0,0 +1,48 @@
+#ifndef XINPUT1_3_SHARDEDCACHE_H
+#define XINPUT1_3_SHARDEDCACHE_H
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+
+/**
+ * Insert-only map safe to use from multiple threads
+ * Keys are spread over independent shards by hash, and lookups only take shared lock of the shard,
+ * so concurrent readers never block each other. Values are never updated once inserted
+ */
+template<typename KeyType, typename ValueType, typename HashType = std::hash<KeyType>, size_t ShardCount = 16>
+class ShardedCache {
+private:
+    struct Shard {
+        mutable std::shared_mutex Mutex;
+        std::unordered_map<KeyType, ValueType, HashType> Entries;
+    };
+    Shard Shards[ShardCount];
+    HashType Hasher;
+
+    inline Shard& GetShard(const KeyType& Key) { return Shards[Hasher(Key) % ShardCount]; }
+public:
+    /** @return true and copies value into OutValue if key is present */
+    bool Find(const KeyType& Key, ValueType& OutValue) {
+        Shard& KeyShard = GetShard(Key);
+        std::shared_lock Guard(KeyShard.Mutex);
+        auto Iterator = KeyShard.Entries.find(Key);
+        if (Iterator == KeyShard.Entries.end()) {
+            return false;
+        }
+        OutValue = Iterator->second;
+        return true;
+    }
+
+    /** Inserts value if key is not present yet, @return value stored in the cache for the key */
+    ValueType Insert(const KeyType& Key, ValueType Value) {
+        Shard& KeyShard = GetShard(Key);
+        std::unique_lock Guard(KeyShard.Mutex);
+        return KeyShard.Entries.emplace(Key, std::move(Value)).first->second;
+    }
+};
+
+#endif //XINPUT1_3_SHARDEDCACHE_H
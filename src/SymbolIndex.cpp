@@ -0,0 +1,175 @@
+#include "SymbolIndex.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+bool PdbSignature::operator==(const PdbSignature& Other) const {
+    return Age == Other.Age && memcmp(Guid, Other.Guid, sizeof(Guid)) == 0;
+}
+
+SymbolIndex::SymbolIndex() : Header(nullptr), Entries(nullptr), StringPool(nullptr) {}
+
+bool SymbolIndex::OpenFile(const std::filesystem::path& FilePath, const PdbSignature& ExpectedSignature) {
+    if (!File.Open(FilePath)) {
+        return false;
+    }
+    if (!ValidateLayout(File.GetData(), File.GetSize()) || Header->Signature != ExpectedSignature) {
+        Header = nullptr;
+        File.Close();
+        return false;
+    }
+    return true;
+}
+
+bool SymbolIndex::OpenBuffer(std::vector<uint8_t>&& Buffer) {
+    OwnedBuffer = std::move(Buffer);
+    return ValidateLayout(OwnedBuffer.data(), OwnedBuffer.size());
+}
+
+static int CompareNames(const char* First, size_t FirstLength, const char* Second, size_t SecondLength) {
+    int Result = memcmp(First, Second, std::min(FirstLength, SecondLength));
+    if (Result != 0) {
+        return Result;
+    }
+    return FirstLength < SecondLength ? -1 : (FirstLength > SecondLength ? 1 : 0);
+}
+
+/** Strings are null terminated, since names are also passed to functions expecting C strings */
+static bool IsStringInPool(const char* StringPool, uint32_t StringPoolSize, uint32_t Offset, uint32_t Length) {
+    return (uint64_t) Offset + Length < StringPoolSize && StringPool[(uint64_t) Offset + Length] == '\0';
+}
+
+bool SymbolIndex::ValidateLayout(const uint8_t* Data, size_t Size) {
+    if (Size < sizeof(SymbolIndexHeader)) {
+        return false;
+    }
+    auto* FileHeader = reinterpret_cast<const SymbolIndexHeader*>(Data);
+    if (FileHeader->Magic != SYMBOL_INDEX_MAGIC || FileHeader->Version != SYMBOL_INDEX_VERSION) {
+        return false;
+    }
+    const uint64_t EntriesSize = (uint64_t) FileHeader->EntryCount * sizeof(SymbolIndexEntry);
+    if (sizeof(SymbolIndexHeader) + EntriesSize + FileHeader->StringPoolSize != Size) {
+        return false;
+    }
+    auto* FileEntries = reinterpret_cast<const SymbolIndexEntry*>(Data + sizeof(SymbolIndexHeader));
+    auto* FileStringPool = reinterpret_cast<const char*>(Data + sizeof(SymbolIndexHeader) + EntriesSize);
+    //truncated or corrupted file with the matching signature should be rebuilt, not read out of bounds by lookups
+    for (uint32_t i = 0; i < FileHeader->EntryCount; i++) {
+        const SymbolIndexEntry& Entry = FileEntries[i];
+        if (!IsStringInPool(FileStringPool, FileHeader->StringPoolSize, Entry.NameOffset, Entry.NameLength) ||
+            !IsStringInPool(FileStringPool, FileHeader->StringPoolSize, Entry.UndecoratedNameOffset, Entry.UndecoratedNameLength)) {
+            return false;
+        }
+        //lookups are binary searches, so entries should be strictly sorted by name
+        if (i != 0) {
+            const SymbolIndexEntry& PreviousEntry = FileEntries[i - 1];
+            if (CompareNames(FileStringPool + PreviousEntry.NameOffset, PreviousEntry.NameLength, FileStringPool + Entry.NameOffset, Entry.NameLength) >= 0) {
+                return false;
+            }
+        }
+    }
+    Header = FileHeader;
+    Entries = FileEntries;
+    StringPool = FileStringPool;
+    return true;
+}
+
+const SymbolIndexEntry* SymbolIndex::FindSymbol(const char* Name, size_t NameLength) const {
+    if (Header == nullptr) {
+        return nullptr;
+    }
+    uint32_t Low = 0;
+    uint32_t High = Header->EntryCount;
+    while (Low < High) {
+        const uint32_t Middle = Low + (High - Low) / 2;
+        const SymbolIndexEntry& Entry = Entries[Middle];
+        const int Result = CompareNames(StringPool + Entry.NameOffset, Entry.NameLength, Name, NameLength);
+        if (Result == 0) {
+            return &Entry;
+        }
+        if (Result < 0) {
+            Low = Middle + 1;
+        } else {
+            High = Middle;
+        }
+    }
+    return nullptr;
+}
+
+void SymbolIndexBuilder::AddSymbol(std::string Name, std::string UndecoratedName, uint32_t RelativeVirtualAddress, uint32_t Flags) {
+    Symbols.push_back(PendingSymbol{std::move(Name), std::move(UndecoratedName), RelativeVirtualAddress, Flags});
+}
+
+static uint32_t AppendString(std::vector<char>& StringPool, const std::string& String) {
+    const auto Offset = (uint32_t) StringPool.size();
+    StringPool.insert(StringPool.end(), String.begin(), String.end());
+    StringPool.push_back('\0');
+    return Offset;
+}
+
+std::vector<uint8_t> SymbolIndexBuilder::Serialize(const PdbSignature& Signature) {
+    //stable sort keeps first added symbol first, so it will be the one described by the merged entry
+    std::stable_sort(Symbols.begin(), Symbols.end(), [](const PendingSymbol& First, const PendingSymbol& Second) {
+        return First.Name < Second.Name;
+    });
+    std::vector<SymbolIndexEntry> Entries;
+    std::vector<char> StringPool;
+    Entries.reserve(Symbols.size());
+    for (size_t i = 0; i < Symbols.size();) {
+        const PendingSymbol& Symbol = Symbols[i];
+        SymbolIndexEntry Entry{};
+        Entry.NameOffset = AppendString(StringPool, Symbol.Name);
+        Entry.NameLength = (uint32_t) Symbol.Name.length();
+        Entry.UndecoratedNameOffset = AppendString(StringPool, Symbol.UndecoratedName);
+        Entry.UndecoratedNameLength = (uint32_t) Symbol.UndecoratedName.length();
+        Entry.RelativeVirtualAddress = Symbol.RelativeVirtualAddress;
+        Entry.Flags = Symbol.Flags;
+        //merge all symbols with the same name into the first one
+        //symbols at the same location are the same symbol seen from different scopes
+        for (i++; i < Symbols.size() && Symbols[i].Name == Symbol.Name; i++) {
+            const PendingSymbol& Duplicate = Symbols[i];
+            const bool bSameAddress = (Duplicate.Flags & SymbolFlag_HasAddress) && (Symbol.Flags & SymbolFlag_HasAddress) &&
+                    Duplicate.RelativeVirtualAddress == Symbol.RelativeVirtualAddress;
+            if (bSameAddress) {
+                Entry.Flags |= Duplicate.Flags;
+            } else {
+                Entry.Flags |= SymbolFlag_MultipleMatch;
+            }
+        }
+        Entries.push_back(Entry);
+    }
+    SymbolIndexHeader Header{};
+    Header.Magic = SYMBOL_INDEX_MAGIC;
+    Header.Version = SYMBOL_INDEX_VERSION;
+    Header.Signature = Signature;
+    Header.EntryCount = (uint32_t) Entries.size();
+    Header.StringPoolSize = (uint32_t) StringPool.size();
+
+    std::vector<uint8_t> Result(sizeof(Header) + Entries.size() * sizeof(SymbolIndexEntry) + StringPool.size());
+    uint8_t* WritePointer = Result.data();
+    memcpy(WritePointer, &Header, sizeof(Header));
+    WritePointer += sizeof(Header);
+    memcpy(WritePointer, Entries.data(), Entries.size() * sizeof(SymbolIndexEntry));
+    WritePointer += Entries.size() * sizeof(SymbolIndexEntry);
+    memcpy(WritePointer, StringPool.data(), StringPool.size());
+    return Result;
+}
+
+bool WriteCacheFile(const std::filesystem::path& FilePath, const std::vector<uint8_t>& Data) {
+    std::filesystem::path TemporaryPath = FilePath;
+    TemporaryPath += ".tmp";
+    {
+        std::ofstream OutputFile(TemporaryPath, std::ios::binary | std::ios::trunc);
+        OutputFile.write(reinterpret_cast<const char*>(Data.data()), (std::streamsize) Data.size());
+        if (!OutputFile.good()) {
+            return false;
+        }
+    }
+    std::error_code ErrorCode;
+    std::filesystem::rename(TemporaryPath, FilePath, ErrorCode);
+    if (ErrorCode) {
+        std::filesystem::remove(TemporaryPath, ErrorCode);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,104 @@
+#ifndef XINPUT1_3_SYMBOLINDEX_H
+#define XINPUT1_3_SYMBOLINDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include "MappedFile.h"
+
+/** Identifies exact PDB matching the executable, as recorded in CodeView debug directory entry */
+struct PdbSignature {
+    uint8_t Guid[16];
+    uint32_t Age;
+
+    bool operator==(const PdbSignature& Other) const;
+    inline bool operator!=(const PdbSignature& Other) const { return !(*this == Other); }
+};
+
+enum SymbolIndexFlags : uint32_t {
+    //Symbol has a static location and RelativeVirtualAddress is valid
+    SymbolFlag_HasAddress = 0x1,
+    SymbolFlag_Virtual = 0x2,
+    SymbolFlag_OptimizedAway = 0x4,
+    //Several symbols with different addresses share this name. Entry describes the first one
+    SymbolFlag_MultipleMatch = 0x8,
+    SymbolFlag_Function = 0x10
+};
+
+//--- ON-DISK FORMAT. BUMP SYMBOL_INDEX_VERSION WHEN CHANGING LAYOUT OF THESE STRUCTS ---
+#define SYMBOL_INDEX_MAGIC 0x58444953 //'SIDX'
+#define SYMBOL_INDEX_VERSION 1
+
+struct SymbolIndexHeader {
+    uint32_t Magic;
+    uint32_t Version;
+    PdbSignature Signature;
+    uint32_t EntryCount;
+    uint32_t StringPoolSize;
+};
+
+//Entries are sorted by name bytes, string pool follows entry array
+struct SymbolIndexEntry {
+    uint32_t NameOffset;
+    uint32_t NameLength;
+    uint32_t UndecoratedNameOffset;
+    uint32_t UndecoratedNameLength;
+    uint32_t RelativeVirtualAddress;
+    uint32_t Flags;
+};
+
+/**
+ * Immutable name -> RVA lookup table for game symbols
+ * Backed either by the memory mapped cache file or by the in-memory buffer
+ */
+class SymbolIndex {
+private:
+    MappedFile File;
+    std::vector<uint8_t> OwnedBuffer;
+    const SymbolIndexHeader* Header;
+    const SymbolIndexEntry* Entries;
+    const char* StringPool;
+public:
+    SymbolIndex();
+
+    /** Maps index file, returns false if it is missing, malformed or was built for another PDB */
+    bool OpenFile(const std::filesystem::path& FilePath, const PdbSignature& ExpectedSignature);
+    /** Takes ownership of serialized index data, returns false if it is malformed */
+    bool OpenBuffer(std::vector<uint8_t>&& Buffer);
+
+    inline bool IsOpen() const { return Header != nullptr; }
+    inline uint32_t GetEntryCount() const { return Header ? Header->EntryCount : 0; }
+    inline const SymbolIndexEntry* GetEntries() const { return Entries; }
+
+    /** @return entry with exactly matching name, or nullptr if there is no such symbol */
+    const SymbolIndexEntry* FindSymbol(const char* Name, size_t NameLength) const;
+    inline const char* GetString(uint32_t Offset) const { return StringPool + Offset; }
+private:
+    bool ValidateLayout(const uint8_t* Data, size_t Size);
+};
+
+/**
+ * Collects symbols and serializes them into the SymbolIndex format
+ * Symbols with the same name and different addresses are merged with SymbolFlag_MultipleMatch set
+ */
+class SymbolIndexBuilder {
+private:
+    struct PendingSymbol {
+        std::string Name;
+        std::string UndecoratedName;
+        uint32_t RelativeVirtualAddress;
+        uint32_t Flags;
+    };
+    std::vector<PendingSymbol> Symbols;
+public:
+    void AddSymbol(std::string Name, std::string UndecoratedName, uint32_t RelativeVirtualAddress, uint32_t Flags);
+    inline size_t GetSymbolCount() const { return Symbols.size(); }
+
+    std::vector<uint8_t> Serialize(const PdbSignature& Signature);
+};
+
+/** Writes data into the temporary file and moves it over the target path */
+bool WriteCacheFile(const std::filesystem::path& FilePath, const std::vector<uint8_t>& Data);
+
+#endif //XINPUT1_3_SYMBOLINDEX_H
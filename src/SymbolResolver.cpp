@@ -5,7 +5,10 @@
 #include "comdef.h"
 #include "util.h"
 #include <psapi.h>
+#include <sstream>
 #include "provided_symbols.h"
+#include "PdbReader.h"
+#include "PeImage.h"
 
 // Implemented in VC CRT (msvcVERSION.dll or vcruntimeVERSION.dll or UCRT (Windows 10 only))
 extern "C" char * __unDName(char* outputString, const char* name, int maxStringLength, void* (*pAlloc)(size_t), void(*pFree)(void*), unsigned short disableFlags);
@@ -20,24 +23,226 @@ extern "C" char * __unDName(char* outputString, const char* name, int maxStringL
 
 HRESULT CoCreateDiaDataSource(HMODULE diaDllHandle, CComPtr<IDiaDataSource>& data_source);
 
-SymbolResolver::SymbolResolver(HMODULE gameModuleHandle, HMODULE diaDllHandle, bool exitOnUnresolvedSymbol) {
+bool ReadImagePdbInfo(HMODULE imageModule, PdbSignature& outSignature, std::string& outPdbPath);
+
+enum SymbolIndexState {
+    SymbolIndexState_Pending,
+    SymbolIndexState_Loading,
+    SymbolIndexState_Ready
+};
+
+SymbolResolver::SymbolResolver(HMODULE gameModuleHandle, const std::filesystem::path& diaDllPath, bool exitOnUnresolvedSymbol, const std::filesystem::path& symbolIndexPath) : symbolIndexState(SymbolIndexState_Pending) {
     this->exitOnUnresolvedSymbol = exitOnUnresolvedSymbol;
+    this->gameModuleHandle = gameModuleHandle;
+    this->diaDllPath = diaDllPath;
+    this->diaDllHandle = nullptr;
+    this->bDiaSessionReleased = false;
+    this->symbolIndexPath = symbolIndexPath;
+    this->gameSignature = PdbSignature{};
+    this->bHasGameSignature = ReadImagePdbInfo(gameModuleHandle, gameSignature, gamePdbPath);
+    //because HMODULE value is the same as the DLL load base address, according to the MS documentation
+    dllBaseAddress = (LPVOID) gameModuleHandle;
+    destructorGenerator = new DestructorGenerator(dllBaseAddress, this);
+    hookRequiredSymbols(*this);
+}
+
+void SymbolResolver::WarmUpSymbolIndex() {
+    {
+        std::lock_guard guard(symbolIndexMutex);
+        if (symbolIndexState != SymbolIndexState_Pending) {
+            //bootstrap thread got there first and is loading it itself
+            return;
+        }
+        symbolIndexState = SymbolIndexState_Loading;
+    }
+    //bootstrap thread keeps logging meanwhile, so messages are kept until FlushWarmUpLog
+    std::ostringstream warmUpLog;
+    warmUpLog << "Loading symbol index on background thread" << std::endl;
+    const bool bLoaded = LoadSymbolIndex(false, warmUpLog);
+    {
+        std::lock_guard guard(warmUpLogMutex);
+        warmUpLogMessages = warmUpLog.str();
+    }
+    {
+        //give it back to the first lookup if we couldn't load it, it will fall back to DIA
+        std::lock_guard guard(symbolIndexMutex);
+        symbolIndexState = bLoaded ? SymbolIndexState_Ready : SymbolIndexState_Pending;
+    }
+    symbolIndexStateChanged.notify_all();
+}
+
+void SymbolResolver::EnsureSymbolIndexLoaded() {
+    if (symbolIndexState == SymbolIndexState_Ready) {
+        return;
+    }
+    std::unique_lock lock(symbolIndexMutex);
+    while (symbolIndexState != SymbolIndexState_Ready) {
+        if (symbolIndexState == SymbolIndexState_Pending) {
+            //warm-up thread hasn't started yet (it is blocked by the loader lock if we're called from DllMain), or failed, do it ourselves
+            symbolIndexState = SymbolIndexState_Loading;
+            lock.unlock();
+            LoadSymbolIndex(true, Logging::logFile);
+            lock.lock();
+            symbolIndexState = SymbolIndexState_Ready;
+            symbolIndexStateChanged.notify_all();
+            return;
+        }
+        symbolIndexStateChanged.wait(lock);
+    }
+}
+
+void SymbolResolver::FlushWarmUpLog() {
+    std::lock_guard guard(warmUpLogMutex);
+    Logging::logFile << warmUpLogMessages;
+    warmUpLogMessages.clear();
+}
+
+CComPtr<IDiaSymbol> SymbolResolver::GetGlobalSymbol() {
+    std::lock_guard guard(generationMutex);
+    if (globalSymbol) {
+        return globalSymbol;
+    }
+    if (bDiaSessionReleased) {
+        Logging::logFile << "[WARNING] Reopening DIA session after it has been released" << std::endl;
+    }
+    if (diaDllHandle == nullptr) {
+        diaDllHandle = LoadLibraryW(diaDllPath.wstring().c_str());
+        if (diaDllHandle == nullptr) {
+            Logging::logFile << "Failed to load DIA SDK implementation DLL." << std::endl;
+            Logging::logFile << "Expected to find it at: " << diaDllPath.string() << std::endl;
+            Logging::logFile << "Make sure it is here and restart. Exiting now." << std::endl;
+            exit(1);
+        }
+    }
+    Logging::logFile << "Opening DIA session for the game executable" << std::endl;
     CComPtr<IDiaDataSource> dataSource;
     HRESULT hr = CoCreateDiaDataSource(diaDllHandle, dataSource);
     CHECK_FAILED(hr, "Failed to create IDiaDatSource: ");
     std::wstring executablePath = getModuleFileName(gameModuleHandle);
-    (*dataSource).loadDataForExe(executablePath.c_str(), nullptr, nullptr);
+    hr = (*dataSource).loadDataForExe(executablePath.c_str(), nullptr, nullptr);
     CHECK_FAILED(hr, "Failed to load DIA data from executable file: ");
     hr = (*dataSource).openSession(&diaSession);
     CHECK_FAILED(hr, "Failed to open DIA session: ");
-    //because HMODULE value is the same as the DLL load base address, according to the MS documentation
     hr = (*diaSession).put_loadAddress(reinterpret_cast<ULONGLONG>(gameModuleHandle));
     CHECK_FAILED(hr, "Failed to update DLL load address on IDiaSession: ");
     hr = (*diaSession).get_globalScope(&globalSymbol);
     CHECK_FAILED(hr, "Failed to retrieve global DLL scope");
-    dllBaseAddress = (LPVOID) gameModuleHandle;
-    destructorGenerator = new DestructorGenerator(dllBaseAddress, globalSymbol);
-    hookRequiredSymbols(*this);
+    return globalSymbol;
+}
+
+void SymbolResolver::ReleaseDiaSession() {
+    std::lock_guard guard(generationMutex);
+    if (!globalSymbol) {
+        Logging::logFile << "DIA session was not opened, nothing to release" << std::endl;
+        return;
+    }
+    globalSymbol.Release();
+    diaSession.Release();
+    bDiaSessionReleased = true;
+    Logging::logFile << "Released DIA session" << std::endl;
+}
+
+bool SymbolResolver::LoadSymbolIndex(bool bAllowDiaFallback, std::ostream& logStream) {
+    if (bHasGameSignature && symbolIndex.OpenFile(symbolIndexPath, gameSignature)) {
+        logStream << "Loaded cached symbol index with " << symbolIndex.GetEntryCount() << " entries" << std::endl;
+        return true;
+    }
+    logStream << "Symbol index cache is missing or outdated, building it from PDB" << std::endl;
+    SymbolIndexBuilder indexBuilder;
+    if (!bHasGameSignature || !BuildSymbolIndexFromPdb(gameSignature, gamePdbPath, indexBuilder, logStream)) {
+        if (!bAllowDiaFallback) {
+            logStream << "Failed to read PDB directly, leaving DIA fallback to the first symbol lookup" << std::endl;
+            return false;
+        }
+        logStream << "[WARNING] Failed to read PDB directly, falling back to DIA" << std::endl;
+        BuildSymbolIndexFromDia(indexBuilder);
+    }
+    std::vector<uint8_t> indexData = indexBuilder.Serialize(gameSignature);
+    if (!bHasGameSignature) {
+        logStream << "[WARNING] Executable doesn't have PDB signature, symbol index will not be cached" << std::endl;
+    } else if (WriteCacheFile(symbolIndexPath, indexData) && symbolIndex.OpenFile(symbolIndexPath, gameSignature)) {
+        logStream << "Saved symbol index with " << symbolIndex.GetEntryCount() << " entries to " << symbolIndexPath.string() << std::endl;
+        return true;
+    } else {
+        logStream << "[WARNING] Failed to write symbol index cache file " << symbolIndexPath.string() << std::endl;
+    }
+    symbolIndex.OpenBuffer(std::move(indexData));
+    return true;
+}
+
+bool SymbolResolver::BuildSymbolIndexFromPdb(const PdbSignature& signature, const std::filesystem::path& pdbPath, SymbolIndexBuilder& indexBuilder, std::ostream& logStream) {
+    //same search order as DIA's loadDataForExe: executable directory first, then path recorded by the linker
+    std::filesystem::path executableDirectory = std::filesystem::path(getModuleFileName(gameModuleHandle)).parent_path();
+    const std::filesystem::path candidatePaths[] = {executableDirectory / pdbPath.filename(), pdbPath};
+    for (const std::filesystem::path& candidatePath : candidatePaths) {
+        PdbReader pdbReader;
+        if (!pdbReader.Open(candidatePath)) {
+            continue;
+        }
+        if (pdbReader.GetSignature() != signature) {
+            logStream << "[WARNING] Ignoring PDB with mismatched signature: " << candidatePath.string() << std::endl;
+            continue;
+        }
+        logStream << "Reading symbols from PDB " << candidatePath.string() << std::endl;
+        AddPdbSymbolsToIndex(pdbReader, indexBuilder);
+        logStream << "Collected " << indexBuilder.GetSymbolCount() << " symbols from PDB" << std::endl;
+        return true;
+    }
+    return false;
+}
+
+static void AddDiaSymbolToIndex(IDiaSymbol* symbol, DWORD symbolTag, SymbolIndexBuilder& indexBuilder) {
+    BSTR name = nullptr;
+    if (symbol->get_name(&name) != S_OK || name == nullptr) {
+        return;
+    }
+    std::string nameString = WideToUtf8(name);
+    SysFreeString(name);
+    std::string undecoratedNameString;
+    BSTR undecoratedName = nullptr;
+    if (symbol->get_undecoratedName(&undecoratedName) == S_OK && undecoratedName != nullptr) {
+        undecoratedNameString = WideToUtf8(undecoratedName);
+        SysFreeString(undecoratedName);
+    }
+    uint32_t flags = 0;
+    DWORD relativeVirtualAddress = 0;
+    DWORD locationType = LocIsNull;
+    symbol->get_locationType(&locationType);
+    if (locationType == LocIsNull) {
+        flags |= SymbolFlag_OptimizedAway;
+    } else if (locationType == LocIsStatic && symbol->get_relativeVirtualAddress(&relativeVirtualAddress) == S_OK) {
+        flags |= SymbolFlag_HasAddress;
+    }
+    BOOL bIsVirtual = FALSE;
+    if (symbol->get_virtual(&bIsVirtual) == S_OK && bIsVirtual) {
+        flags |= SymbolFlag_Virtual;
+    }
+    BOOL bIsFunction = symbolTag == SymTagFunction;
+    if (symbolTag == SymTagPublicSymbol) {
+        symbol->get_function(&bIsFunction);
+    }
+    if (bIsFunction) {
+        flags |= SymbolFlag_Function;
+    }
+    indexBuilder.AddSymbol(std::move(nameString), std::move(undecoratedNameString), relativeVirtualAddress, flags);
+}
+
+void SymbolResolver::BuildSymbolIndexFromDia(SymbolIndexBuilder& indexBuilder) {
+    std::lock_guard guard(generationMutex);
+    //public symbols are looked up by mangled names, functions and data by undecorated ones
+    const enum SymTagEnum indexedSymbolTags[] = {SymTagPublicSymbol, SymTagFunction, SymTagData};
+    for (enum SymTagEnum symbolTag : indexedSymbolTags) {
+        CComPtr<IDiaEnumSymbols> enumSymbols;
+        HRESULT hr = (*GetGlobalSymbol()).findChildren(symbolTag, nullptr, nsNone, &enumSymbols);
+        CHECK_FAILED(hr, "Failed to enumerate executable symbols: ");
+        CComPtr<IDiaSymbol> symbol;
+        ULONG fetchedCount = 0;
+        while (SUCCEEDED(enumSymbols->Next(1, &symbol, &fetchedCount)) && fetchedCount == 1) {
+            AddDiaSymbolToIndex(symbol, symbolTag, indexBuilder);
+            symbol.Release();
+        }
+    }
+    Logging::logFile << "Collected " << indexBuilder.GetSymbolCount() << " symbols from PDB" << std::endl;
 }
 
 void DummyUnresolvedSymbolHandler(const char* symbolName) {
@@ -48,41 +253,159 @@ void DummyUnresolvedSymbolHandler(const char* symbolName) {
 }
 
 void* SymbolResolver::ResolveSymbol(const char* mangledSymbolName) {
-    USES_CONVERSION;
-    const wchar_t* resultName = A2CW(mangledSymbolName);
-    CComPtr<IDiaEnumSymbols> enumSymbols;
-    HRESULT hr = (*globalSymbol).findChildren(SymTagNull, resultName, nsfCaseSensitive, &enumSymbols);
-    CHECK_FAILED(hr, "Failed find symbol in executable: ");
-    LONG symbolCount = 0L;
-    enumSymbols->get_Count(&symbolCount);
-    if (symbolCount == 0L) {
-        void* providedSymbolPointer = provideSymbolImplementation(mangledSymbolName);
-        if (providedSymbolPointer != nullptr) {
-            return providedSymbolPointer; //fallback to provided symbol
+    const std::string symbolNameString = mangledSymbolName;
+    void* symbolAddress;
+    if (resolvedSymbolCache.Find(symbolNameString, symbolAddress)) {
+        resolvedSymbolCacheCounters.RecordHit();
+        return symbolAddress;
+    }
+    resolvedSymbolCacheCounters.RecordMiss();
+    return resolvedSymbolCache.Insert(symbolNameString, ResolveSymbolUncached(symbolNameString));
+}
+
+void* SymbolResolver::ResolveSymbolUncached(const std::string& symbolNameString) {
+    const char* mangledSymbolName = symbolNameString.c_str();
+    //index is read-only once loaded, so lookups don't need the generation lock
+    EnsureSymbolIndexLoaded();
+    const SymbolIndexEntry* indexEntry = symbolIndex.FindSymbol(mangledSymbolName, symbolNameString.length());
+    if (indexEntry != nullptr && (indexEntry->Flags & SymbolFlag_HasAddress)) {
+        return reinterpret_cast<void *>((unsigned long long)dllBaseAddress + indexEntry->RelativeVirtualAddress);
+    }
+    //provided and dummy symbols generate code, so they are resolved one at a time
+    std::lock_guard guard(generationMutex);
+    //another thread could have resolved it while we were waiting for the lock
+    void* symbolAddress;
+    if (resolvedSymbolCache.Find(symbolNameString, symbolAddress)) {
+        return symbolAddress;
+    }
+    void* providedSymbolPointer = provideSymbolImplementation(mangledSymbolName);
+    if (providedSymbolPointer != nullptr) {
+        return providedSymbolPointer; //fallback to provided symbol
+    }
+    Logging::logFile << "[FATAL] Executable missing symbol with mangled name: " << mangledSymbolName << std::endl;
+    char* demangledName = __unDName(nullptr, mangledSymbolName, 0, malloc, free, 0);
+    Logging::logFile << "[FATAL] De-mangled symbol name (for reference): " << demangledName << std::endl;
+    free(demangledName);
+    if (exitOnUnresolvedSymbol) {
+        Logging::logFile << "[FATAL] Strict mode enabled. Aborting on missing symbol." << std::endl;
+        exit(1);
+    }
+    Logging::logFile << "[FATAL] Overriding it with dummy symbol. Bad things will happen if it is going to be actually called!" << std::endl;
+    return generateDummySymbol(demangledName, &DummyUnresolvedSymbolHandler);
+}
+
+bool SymbolResolver::IsFunctionSymbol(const char* mangledSymbolName) {
+    EnsureSymbolIndexLoaded();
+    const SymbolIndexEntry* indexEntry = symbolIndex.FindSymbol(mangledSymbolName, strlen(mangledSymbolName));
+    return indexEntry != nullptr && (indexEntry->Flags & SymbolFlag_HasAddress) && (indexEntry->Flags & SymbolFlag_Function);
+}
+
+//undecorated names of virtual functions look like "public: virtual void __cdecl AActor::Tick(float)"
+static bool IsVirtualFunctionUndecoratedName(const char* UndecoratedName) {
+    return strstr(UndecoratedName, ": virtual ") != nullptr;
+}
+
+SymbolDigestInfo SymbolResolver::DigestGameSymbol(const wchar_t* SymbolName) {
+    std::wstring UndecoratedName;
+    SymbolDigestInfo ResultDigestInfo = DigestGameSymbolInternal(SymbolName, UndecoratedName);
+    if (!ResultDigestInfo.bSymbolNotFound && !ResultDigestInfo.bMultipleSymbolsMatch) {
+        ResultDigestInfo.SymbolName.String = SysAllocStringLen(UndecoratedName.data(), (UINT) UndecoratedName.length());
+        ResultDigestInfo.SymbolName.StringFree = &SysFreeString;
+    }
+    return ResultDigestInfo;
+}
+
+static void FreeArenaString(wchar_t*) {
+    //strings live in the caller-provided arena, nothing to free
+}
+
+uint64_t SymbolResolver::DigestGameSymbols(const wchar_t* const* SymbolNames, uint64_t SymbolCount, SymbolDigestInfo* OutDigestInfos, wchar_t* StringArena, uint64_t StringArenaSize) {
+    uint64_t RequiredArenaSize = 0;
+    std::wstring UndecoratedName;
+    for (uint64_t i = 0; i < SymbolCount; i++) {
+        SymbolDigestInfo& DigestInfo = OutDigestInfos[i];
+        DigestInfo = DigestGameSymbolInternal(SymbolNames[i], UndecoratedName);
+        if (DigestInfo.bSymbolNotFound || DigestInfo.bMultipleSymbolsMatch) {
+            continue;
         }
-        Logging::logFile << "[FATAL] Executable missing symbol with mangled name: " << mangledSymbolName << std::endl;
-        char* demangledName = __unDName(nullptr, mangledSymbolName, 0, malloc, free, 0);
-        Logging::logFile << "[FATAL] De-mangled symbol name (for reference): " << demangledName << std::endl;
-        free(demangledName);
-        if (exitOnUnresolvedSymbol) {
-            Logging::logFile << "[FATAL] Strict mode enabled. Aborting on missing symbol." << std::endl;
-            exit(1);
+        const uint64_t StringSize = UndecoratedName.length() + 1;
+        DigestInfo.SymbolName.StringFree = &FreeArenaString;
+        if (StringArena != nullptr && RequiredArenaSize + StringSize <= StringArenaSize) {
+            wchar_t* StringLocation = StringArena + RequiredArenaSize;
+            memcpy(StringLocation, UndecoratedName.c_str(), StringSize * sizeof(wchar_t));
+            DigestInfo.SymbolName.String = StringLocation;
         }
-        Logging::logFile << "[FATAL] Overriding it with dummy symbol. Bad things will happen if it is going to be actually called!" << std::endl;
-        return generateDummySymbol(demangledName, &DummyUnresolvedSymbolHandler);
+        RequiredArenaSize += StringSize;
     }
-    CComPtr<IDiaSymbol> resolvedSymbol;
-    hr = enumSymbols->Item(0, &resolvedSymbol);
-    CHECK_FAILED(hr, "Failed to retrieve first matching symbol: ");
-    DWORD resultAddress;
-    hr = resolvedSymbol->get_relativeVirtualAddress(&resultAddress);
-    CHECK_FAILED(hr, "Failed to retrieve symbol relative virtual address: ");
-    return reinterpret_cast<void *>((unsigned long long)dllBaseAddress + resultAddress);
+    return RequiredArenaSize;
 }
 
-SymbolDigestInfo SymbolResolver::DigestGameSymbol(const wchar_t* SymbolName) {
+SymbolDigestInfo SymbolResolver::DigestGameSymbolInternal(const wchar_t* SymbolName, std::wstring& OutUndecoratedName) {
+    const std::wstring SymbolNameString = SymbolName;
+    CachedSymbolDigest CachedDigest{};
+    if (symbolDigestCache.Find(SymbolNameString, CachedDigest)) {
+        symbolDigestCacheCounters.RecordHit();
+        OutUndecoratedName = std::move(CachedDigest.UndecoratedName);
+        return CachedDigest.DigestInfo;
+    }
+    symbolDigestCacheCounters.RecordMiss();
+    //results don't depend on the order of lookups, so if another thread digests the same symbol meanwhile, first one is kept
+    CachedDigest.DigestInfo = DigestGameSymbolUncached(SymbolName, CachedDigest.UndecoratedName);
+    CachedDigest = symbolDigestCache.Insert(SymbolNameString, std::move(CachedDigest));
+    OutUndecoratedName = std::move(CachedDigest.UndecoratedName);
+    return CachedDigest.DigestInfo;
+}
+
+SymbolDigestInfo SymbolResolver::DigestGameSymbolUncached(const wchar_t* SymbolName, std::wstring& OutUndecoratedName) {
+    //index is read-only once loaded, so only DIA fallback takes the generation lock
+    EnsureSymbolIndexLoaded();
+    const std::string SymbolNameString = WideToUtf8(SymbolName);
+    const SymbolIndexEntry* IndexEntry = symbolIndex.FindSymbol(SymbolNameString.data(), SymbolNameString.length());
+    SymbolDigestInfo ResultDigestInfo{};
+    if (IndexEntry == nullptr) {
+        //index built from PDB public symbols only knows decorated names,
+        //so undecorated ones need to be looked up through DIA
+        if (SymbolName[0] != L'?') {
+            return DigestGameSymbolFromDia(SymbolName, OutUndecoratedName);
+        }
+        ResultDigestInfo.bSymbolNotFound = true;
+        return ResultDigestInfo;
+    }
+    if (IndexEntry->Flags & SymbolFlag_MultipleMatch) {
+        ResultDigestInfo.bMultipleSymbolsMatch = true;
+        return ResultDigestInfo;
+    }
+    const char* IndexName = symbolIndex.GetString(IndexEntry->NameOffset);
+    bool bIsVirtual = (IndexEntry->Flags & SymbolFlag_Virtual) != 0;
+    if (IndexEntry->UndecoratedNameLength != 0) {
+        OutUndecoratedName = Utf8ToWide(symbolIndex.GetString(IndexEntry->UndecoratedNameOffset), IndexEntry->UndecoratedNameLength);
+    } else if (IndexName[0] == '?') {
+        //decorated name without stored undecorated one, undecorate it now
+        char* DemangledName = __unDName(nullptr, IndexName, 0, malloc, free, 0);
+        OutUndecoratedName = Utf8ToWide(DemangledName, strlen(DemangledName));
+        bIsVirtual |= IsVirtualFunctionUndecoratedName(DemangledName);
+        free(DemangledName);
+    } else {
+        //symbols without decorated name (C functions, data) use plain name as undecorated one
+        OutUndecoratedName = Utf8ToWide(IndexName, IndexEntry->NameLength);
+    }
+    if (IndexEntry->Flags & SymbolFlag_OptimizedAway) {
+        ResultDigestInfo.bSymbolOptimizedAway = true;
+        return ResultDigestInfo;
+    }
+    ResultDigestInfo.bSymbolVirtual = bIsVirtual;
+
+    if (IndexEntry->Flags & SymbolFlag_HasAddress) {
+        void* SymbolPointer = reinterpret_cast<void*>((uint64_t)dllBaseAddress + IndexEntry->RelativeVirtualAddress);
+        ResultDigestInfo.SymbolImplementationPointer = SymbolPointer;
+    }
+    return ResultDigestInfo;
+}
+
+SymbolDigestInfo SymbolResolver::DigestGameSymbolFromDia(const wchar_t* SymbolName, std::wstring& OutUndecoratedName) {
+    std::lock_guard Guard(generationMutex);
     CComPtr<IDiaEnumSymbols> enumSymbols;
-    HRESULT hr = (*globalSymbol).findChildren(SymTagNull, SymbolName, nsfCaseSensitive, &enumSymbols);
+    HRESULT hr = (*GetGlobalSymbol()).findChildren(SymTagNull, SymbolName, nsfCaseSensitive, &enumSymbols);
     CHECK_FAILED(hr, "findChildren failed in executable");
     LONG SymbolCount = 0L;
     enumSymbols->get_Count(&SymbolCount);
@@ -97,8 +420,10 @@ SymbolDigestInfo SymbolResolver::DigestGameSymbol(const wchar_t* SymbolName) {
     }
     CComPtr<IDiaSymbol> ResultSymbol;
     enumSymbols->Item(0, &ResultSymbol);
-    ResultSymbol->get_undecoratedName(&ResultDigestInfo.SymbolName.String);
-    ResultDigestInfo.SymbolName.StringFree = &SysFreeString;
+    BSTR UndecoratedName = nullptr;
+    ResultSymbol->get_undecoratedName(&UndecoratedName);
+    OutUndecoratedName = UndecoratedName != nullptr ? UndecoratedName : L"";
+    SysFreeString(UndecoratedName);
     DWORD LocationType = 0;
     ResultSymbol->get_locationType(&LocationType);
     if (LocationType == LocIsNull) {
@@ -137,3 +462,15 @@ HRESULT CoCreateDiaDataSource(HMODULE diaDllHandle, CComPtr<IDiaDataSource>& dat
     }
     return S_OK;
 }
+
+bool ReadImagePdbInfo(HMODULE imageModule, PdbSignature& outSignature, std::string& outPdbPath) {
+    PeImage image;
+    PeCodeViewInfo codeViewInfo{};
+    if (!image.OpenLoadedImage(imageModule) || !image.GetCodeViewInfo(codeViewInfo)) {
+        return false;
+    }
+    memcpy(outSignature.Guid, codeViewInfo.Guid, sizeof(outSignature.Guid));
+    outSignature.Age = codeViewInfo.Age;
+    outPdbPath = codeViewInfo.PdbPath;
+    return true;
+}
@@ -8,21 +8,115 @@
 #include <dia2.h>
 #include <vector>
 #include <string>
+#include <filesystem>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include "exports.h"
+#include "SymbolIndex.h"
+#include "CacheCounters.h"
+#include "ShardedCache.h"
 
 class SymbolResolver {
 public:
-    CComPtr<IDiaSession> diaSession;
-    CComPtr<IDiaSymbol> globalSymbol;
     bool exitOnUnresolvedSymbol;
     LPVOID dllBaseAddress;
     class DestructorGenerator* destructorGenerator;
+private:
+    HMODULE gameModuleHandle;
+    //DIA implementation DLL is only loaded when DIA session is opened
+    std::filesystem::path diaDllPath;
+    HMODULE diaDllHandle;
+    //DIA session is only opened when index can't answer the query (type information, undecorated names)
+    CComPtr<IDiaSession> diaSession;
+    CComPtr<IDiaSymbol> globalSymbol;
+    bool bDiaSessionReleased;
+    SymbolIndex symbolIndex;
+    std::filesystem::path symbolIndexPath;
+    bool bHasGameSignature;
+    PdbSignature gameSignature;
+    std::string gamePdbPath;
+    //one of SymbolIndexState values, see EnsureSymbolIndexLoaded
+    //only changed with symbolIndexMutex held, but read without it once the index is ready
+    std::atomic<int> symbolIndexState;
+    std::mutex symbolIndexMutex;
+    std::condition_variable symbolIndexStateChanged;
+    //messages of the warm-up thread, written into the log by FlushWarmUpLog
+    std::mutex warmUpLogMutex;
+    std::string warmUpLogMessages;
+    //results are stable for the lifetime of the process, so lookups are memoized by symbol name
+    struct CachedSymbolDigest {
+        //symbol name is not set, it is allocated for each caller from UndecoratedName
+        SymbolDigestInfo DigestInfo;
+        std::wstring UndecoratedName;
+    };
+    ShardedCache<std::string, void*> resolvedSymbolCache;
+    CacheCounters resolvedSymbolCacheCounters;
+    ShardedCache<std::wstring, CachedSymbolDigest> symbolDigestCache;
+    CacheCounters symbolDigestCacheCounters;
+    //DIA session, code generation and provided symbols are not thread safe, so misses which need them are served one at a time
+    //recursive because provided symbols resolve other symbols, and generated code queries DIA
+    std::recursive_mutex generationMutex;
 public:
-    explicit SymbolResolver(HMODULE gameModuleHandle, HMODULE diaDllHandle, bool exitOnUnresolvedSymbol);
+    /**
+     * Symbol index is not loaded by the constructor, it is loaded either by WarmUpSymbolIndex
+     * from the background thread or on the first symbol lookup, whichever comes first
+     * @param symbolIndexPath path to the persistent symbol index cache file.
+     * It is rebuilt automatically when the executable's PDB signature changes
+     */
+    explicit SymbolResolver(HMODULE gameModuleHandle, const std::filesystem::path& diaDllPath, bool exitOnUnresolvedSymbol, const std::filesystem::path& symbolIndexPath);
     ~SymbolResolver();
 
     SymbolDigestInfo DigestGameSymbol(const wchar_t* SymbolName);
+    /** Digests symbols in bulk, writing their names into the string arena. See DigestGameSymbolsFunc */
+    uint64_t DigestGameSymbols(const wchar_t* const* SymbolNames, uint64_t SymbolCount, SymbolDigestInfo* OutDigestInfos, wchar_t* StringArena, uint64_t StringArenaSize);
     void* ResolveSymbol(const char* mangledSymbolName);
+    /** Returns true if symbol is known to be a function, false if it is data or not present in the index */
+    bool IsFunctionSymbol(const char* mangledSymbolName);
+
+    /**
+     * Retrieves signature of the game PDB from the CodeView record of the executable
+     * @return false if executable doesn't reference any PDB
+     */
+    inline bool GetGameSignature(PdbSignature& outSignature) const { outSignature = gameSignature; return bHasGameSignature; }
+
+    /** Returns DIA global scope symbol of the executable, opening DIA session on the first call */
+    CComPtr<IDiaSymbol> GetGlobalSymbol();
+
+    /**
+     * Releases DIA session and all memory it holds. Symbol lookups will be served from the index only,
+     * DIA session will be reopened if something still needs it (destructor generation, undecorated name lookups)
+     */
+    void ReleaseDiaSession();
+
+    /**
+     * Loads symbol index ahead of the first lookup, meant to be called from the background thread
+     * Only the cache file and the native PDB reader are used, because DIA fallback loads DLLs and would
+     * deadlock when the bootstrap thread waits for it while holding the loader lock. If they fail,
+     * index is loaded with DIA fallback by the first lookup instead
+     */
+    void WarmUpSymbolIndex();
+
+    /** Writes messages of the finished warm-up into the log, should be called from the thread doing the logging */
+    void FlushWarmUpLog();
+
+    inline const CacheCounters& GetResolvedSymbolCacheCounters() const { return resolvedSymbolCacheCounters; }
+    inline const CacheCounters& GetSymbolDigestCacheCounters() const { return symbolDigestCacheCounters; }
+
+    /** Lock serializing access to the DIA session and code generation, shared with the DestructorGenerator */
+    inline std::recursive_mutex& GetGenerationMutex() { return generationMutex; }
+private:
+    /** Blocks until symbol index is loaded, loading it on the calling thread if nobody is loading it yet */
+    void EnsureSymbolIndexLoaded();
+    bool LoadSymbolIndex(bool bAllowDiaFallback, std::ostream& logStream);
+    bool BuildSymbolIndexFromPdb(const PdbSignature& signature, const std::filesystem::path& pdbPath, SymbolIndexBuilder& indexBuilder, std::ostream& logStream);
+    void BuildSymbolIndexFromDia(SymbolIndexBuilder& indexBuilder);
+    /** Looks symbol up in the index, generation lock is only taken for symbols missing from it */
+    void* ResolveSymbolUncached(const std::string& symbolNameString);
+    /** Digests symbol without allocating its name, which is returned separately. Results are memoized */
+    SymbolDigestInfo DigestGameSymbolInternal(const wchar_t* SymbolName, std::wstring& OutUndecoratedName);
+    SymbolDigestInfo DigestGameSymbolUncached(const wchar_t* SymbolName, std::wstring& OutUndecoratedName);
+    SymbolDigestInfo DigestGameSymbolFromDia(const wchar_t* SymbolName, std::wstring& OutUndecoratedName);
 };
 
 #endif //XINPUT1_3_SYMBOLRESOLVER_H
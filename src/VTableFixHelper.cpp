@@ -1,46 +1,271 @@
 #include "VTableFixHelper.h"
+#include "PeImage.h"
 #include <unordered_map>
+#include <mutex>
 
-static std::unordered_map<uint8_t*, uint8_t*> CachedVirtualTables;
+//tables are never longer than that, it is also the size used when table can't be measured
+#define MAX_VIRTUAL_TABLE_SIZE 4096
 
+struct ImageSectionRange {
+    uintptr_t BeginAddress;
+    uintptr_t EndAddress;
+    bool bExecutable;
+};
+
+//guards recorded table sizes, fix entries and cached tables of all definitions
+static std::mutex VirtualTableCacheMutex;
+//definitions with registered original tables, definitions are never freed
+static std::vector<VTableDefinition*> RegisteredDefinitions;
+static std::vector<ImageSectionRange> GameImageSections;
+//sizes of tables measured before patching them in place, since hooked slots no longer point into the game image
+static std::unordered_map<uint8_t*, uint32_t> PatchedInPlaceTableSizes;
+
+void InitializeVirtualTableSizing(const void* GameImageBase) {
+    PeImage Image;
+    if (!Image.OpenLoadedImage(GameImageBase)) {
+        return;
+    }
+    for (uint16_t i = 0; i < Image.GetSectionCount(); i++) {
+        PeSectionHeader Section{};
+        if (Image.GetSection(i, Section)) {
+            const uintptr_t BeginAddress = (uintptr_t) GameImageBase + Section.VirtualAddress;
+            GameImageSections.push_back(ImageSectionRange{BeginAddress, BeginAddress + Section.VirtualSize, (Section.Characteristics & PE_SECTION_EXECUTABLE) != 0});
+        }
+    }
+}
+
+static const ImageSectionRange* FindGameImageSection(uintptr_t Address) {
+    for (const ImageSectionRange& Section : GameImageSections) {
+        if (Address >= Section.BeginAddress && Address < Section.EndAddress) {
+            return &Section;
+        }
+    }
+    return nullptr;
+}
+
+/** Should be called with the cache lock held */
 uint32_t DetermineVirtualTableSize(void* VirtualTablePtr) {
+    auto RecordedSizeIterator = PatchedInPlaceTableSizes.find((uint8_t*) VirtualTablePtr);
+    if (RecordedSizeIterator != PatchedInPlaceTableSizes.end()) {
+        return RecordedSizeIterator->second;
+    }
     //DIA seems to be unable to give exact virtual table size
     //tried get_length and get_staticSize - both return 0 at SymTagPublicSymbol
-    //Fallback to 4kB virtual table size for now - it's big enough for most classes
-    //without bloating memory too much with hooked virtual tables
-    return 4096;
+    //So table is measured by its contents: every slot points into the executable section of the game,
+    //and the table ends at the first slot which doesn't, usually RTTI locator of the next table
+    const ImageSectionRange* TableSection = FindGameImageSection((uintptr_t) VirtualTablePtr);
+    if (TableSection == nullptr) {
+        //table is not in the game image, so there is nothing to measure it against, only stay within its memory region
+        MEMORY_BASIC_INFORMATION MemoryInfo;
+        if (VirtualQuery(VirtualTablePtr, &MemoryInfo, sizeof(MemoryInfo)) == 0 || MemoryInfo.State != MEM_COMMIT) {
+            return 0;
+        }
+        const uintptr_t RegionSize = (uintptr_t) MemoryInfo.BaseAddress + MemoryInfo.RegionSize - (uintptr_t) VirtualTablePtr;
+        return (uint32_t) (RegionSize < MAX_VIRTUAL_TABLE_SIZE ? RegionSize & ~(sizeof(void*) - 1) : MAX_VIRTUAL_TABLE_SIZE);
+    }
+    uint32_t TableSize = 0;
+    auto** SlotPointer = (void**) VirtualTablePtr;
+    while (TableSize < MAX_VIRTUAL_TABLE_SIZE && (uintptr_t) (SlotPointer + 1) <= TableSection->EndAddress) {
+        const ImageSectionRange* FunctionSection = FindGameImageSection((uintptr_t) *SlotPointer);
+        if (FunctionSection == nullptr || !FunctionSection->bExecutable) {
+            break;
+        }
+        TableSize += sizeof(void*);
+        SlotPointer++;
+    }
+    return TableSize;
+}
+
+/** RTTI complete object locator is stored right before the first slot, it should be kept so RTTI works with the cloned table */
+static bool HasObjectLocatorSlot(uint8_t* OriginalTable) {
+    const ImageSectionRange* TableSection = FindGameImageSection((uintptr_t) OriginalTable);
+    return TableSection != nullptr && (uintptr_t) OriginalTable - sizeof(void*) >= TableSection->BeginAddress;
 }
 
-uint8_t* CreateAndCacheVirtualTable(uint8_t* OriginalTable, VTableDefinition& Definition) {
-    auto RemoveIterator = CachedVirtualTables.find(OriginalTable);
-    if (Definition.bFlushCaches && RemoveIterator != CachedVirtualTables.end()) {
-        //Remove old value and free memory it occupied
-        CachedVirtualTables.erase(RemoveIterator);
-        free(RemoveIterator->second);
+/**
+ * Finds or builds patched table for the definition and publishes it as the last patched one
+ * Should be called with the cache lock held, so fixes added concurrently are never overwritten by the stale table
+ */
+static const PatchedVirtualTable* CreateAndCacheVirtualTableLocked(uint8_t* OriginalTable, VTableDefinition& Definition) {
+    if (Definition.bFlushCaches) {
+        Definition.bFlushCaches = false;
+        //Old tables are not freed, since objects constructed earlier still use them
+        Definition.CachedTables.clear();
+    } else {
+        auto CacheIterator = Definition.CachedTables.find(OriginalTable);
+        if (CacheIterator != Definition.CachedTables.end()) {
+            Definition.LastPatchedTable.store(CacheIterator->second, std::memory_order_release);
+            return CacheIterator->second;
+        }
+    }
+    //Only measured table is copied, but clone is extended to hold overridden slots past its end
+    const size_t TableSize = DetermineVirtualTableSize(OriginalTable);
+    size_t AllocationSize = TableSize;
+    for (const VTableFixEntry& FixEntry : Definition.FixEntries) {
+        if (FixEntry.FunctionEntryOffset + sizeof(void*) > AllocationSize) {
+            AllocationSize = FixEntry.FunctionEntryOffset + sizeof(void*);
+        }
     }
-    Definition.bFlushCaches = false;
     //Allocate enough memory, copy values, apply overrides
-    size_t TableSize = DetermineVirtualTableSize(OriginalTable);
-    auto* NewVirtualTable = (uint8_t*) malloc(TableSize);
-    memcpy(NewVirtualTable, OriginalTable, TableSize);
+    const size_t PrefixSize = HasObjectLocatorSlot(OriginalTable) ? sizeof(void*) : 0;
+    auto* NewTableMemory = (uint8_t*) calloc(1, PrefixSize + AllocationSize);
+    memcpy(NewTableMemory, OriginalTable - PrefixSize, PrefixSize + TableSize);
+    uint8_t* NewVirtualTable = NewTableMemory + PrefixSize;
     //Apply overrides now
+    const ImageSectionRange* TableSection = FindGameImageSection((uintptr_t) OriginalTable);
     for (VTableFixEntry& FixEntry : Definition.FixEntries) {
         void** FunctionPointer = (void**) (NewVirtualTable + FixEntry.FunctionEntryOffset);
+        if (FixEntry.FunctionEntryOffset >= TableSize) {
+            //Slot past the measured end, only that slot is read from the original table, if it is still inside of its section
+            const uintptr_t OriginalSlot = (uintptr_t) (OriginalTable + FixEntry.FunctionEntryOffset);
+            const bool bSlotReadable = TableSection != nullptr && OriginalSlot + sizeof(void*) <= TableSection->EndAddress;
+            *FunctionPointer = bSlotReadable ? *(void**) OriginalSlot : nullptr;
+        }
         *FixEntry.OutOriginalFunctionPtr = *FunctionPointer;
         *FunctionPointer = FixEntry.FunctionToCallInstead;
     }
     //Add our entry to the caches map and return it
-    CachedVirtualTables.insert({OriginalTable, NewVirtualTable});
-    return NewVirtualTable;
+    auto* PatchedTable = new PatchedVirtualTable{OriginalTable, NewVirtualTable};
+    Definition.CachedTables.insert({OriginalTable, PatchedTable});
+    Definition.LastPatchedTable.store(PatchedTable, std::memory_order_release);
+    return PatchedTable;
+}
+
+/** Should be called with the cache lock held */
+static VTableDefinition& FindOrAddDefinition(ConstructorFixInfo* FixInfo, unsigned int VirtualTableOriginOffset) {
+    const VTableDefinitionList* OldList = FixInfo->Fixes.load(std::memory_order_acquire);
+    if (OldList != nullptr) {
+        for (VTableDefinition* Definition : OldList->Definitions) {
+            if (Definition->VirtualTableOriginOffset == VirtualTableOriginOffset) {
+                return *Definition;
+            }
+        }
+    }
+    //Constructors can still be iterating the old list, so it is replaced instead of being modified, and never freed
+    auto* NewDefinition = new VTableDefinition(VirtualTableOriginOffset);
+    auto* NewList = new VTableDefinitionList{};
+    if (OldList != nullptr) {
+        NewList->Definitions = OldList->Definitions;
+    }
+    NewList->Definitions.push_back(NewDefinition);
+    FixInfo->Fixes.store(NewList, std::memory_order_release);
+    return *NewDefinition;
+}
+
+void AddVirtualTableFix(ConstructorFixInfo* FixInfo, unsigned int VirtualTableOriginOffset, const VTableFixEntry& FixEntry) {
+    std::lock_guard Guard(VirtualTableCacheMutex);
+    VTableDefinition& Definition = FindOrAddDefinition(FixInfo, VirtualTableOriginOffset);
+    Definition.FixEntries.push_back(FixEntry);
+    Definition.bFlushCaches = true;
+    Definition.LastPatchedTable.store(nullptr, std::memory_order_release);
+}
+
+bool RegisterOriginalVirtualTable(ConstructorFixInfo* FixInfo, unsigned int VirtualTableOriginOffset, void* OriginalTable) {
+    //virtual tables live in the read-only data of the game image, anything else would be built from garbage
+    const ImageSectionRange* TableSection = FindGameImageSection((uintptr_t) OriginalTable);
+    if (TableSection == nullptr || TableSection->bExecutable) {
+        return false;
+    }
+    std::lock_guard Guard(VirtualTableCacheMutex);
+    if (DetermineVirtualTableSize(OriginalTable) == 0) {
+        return false;
+    }
+    VTableDefinition& Definition = FindOrAddDefinition(FixInfo, VirtualTableOriginOffset);
+    if (Definition.RegisteredOriginalTable == nullptr) {
+        RegisteredDefinitions.push_back(&Definition);
+    }
+    Definition.RegisteredOriginalTable = (uint8_t*) OriginalTable;
+    return true;
+}
+
+uint32_t BuildRegisteredVirtualTables() {
+    std::lock_guard Guard(VirtualTableCacheMutex);
+    uint32_t BuiltTableCount = 0;
+    for (VTableDefinition* Definition : RegisteredDefinitions) {
+        //definitions without fixes would just install the copy of the original table
+        if (!Definition->FixEntries.empty()) {
+            CreateAndCacheVirtualTableLocked(Definition->RegisteredOriginalTable, *Definition);
+            BuiltTableCount++;
+        }
+    }
+    return BuiltTableCount;
+}
+
+bool GetPrecomputedVirtualTables(ConstructorFixInfo* FixInfo, std::vector<PrecomputedVirtualTable>& OutVirtualTables) {
+    std::lock_guard Guard(VirtualTableCacheMutex);
+    const VTableDefinitionList* DefinitionList = FixInfo->Fixes.load(std::memory_order_acquire);
+    if (DefinitionList == nullptr) {
+        return false;
+    }
+    for (const VTableDefinition* Definition : DefinitionList->Definitions) {
+        const PatchedVirtualTable* PatchedTable = Definition->LastPatchedTable.load(std::memory_order_acquire);
+        if (Definition->bFlushCaches || PatchedTable == nullptr || PatchedTable->OriginalTable != Definition->RegisteredOriginalTable) {
+            return false;
+        }
+        OutVirtualTables.push_back(PrecomputedVirtualTable{Definition->VirtualTableOriginOffset, PatchedTable->OriginalTable, PatchedTable->PatchedTable});
+    }
+    return !OutVirtualTables.empty();
+}
+
+bool PatchVirtualTableInPlace(void* VirtualTable, const std::vector<VTableFixEntry>& FixEntries) {
+    //same checks as for registered tables, code pages would lose execute permission while slots are written
+    const ImageSectionRange* TableSection = FindGameImageSection((uintptr_t) VirtualTable);
+    if (TableSection == nullptr || TableSection->bExecutable || FixEntries.empty()) {
+        return false;
+    }
+    auto* TableStart = (uint8_t*) VirtualTable;
+    std::lock_guard Guard(VirtualTableCacheMutex);
+    //Size is recorded before any slot is hooked, so tables cloned later still cover the hooked slots
+    const uint32_t MeasuredSize = DetermineVirtualTableSize(TableStart);
+    if (MeasuredSize == 0) {
+        return false;
+    }
+    //Compute range covering all overridden slots, so protection only needs to be changed once
+    //slots past the measured end belong to the next table or its RTTI locator, so they are never written
+    uint32_t FirstSlotOffset = UINT32_MAX;
+    uint32_t EndSlotOffset = 0;
+    for (const VTableFixEntry& FixEntry : FixEntries) {
+        if (FixEntry.FunctionEntryOffset + (uint64_t) sizeof(void*) > MeasuredSize) {
+            return false;
+        }
+        if (FixEntry.FunctionEntryOffset < FirstSlotOffset) {
+            FirstSlotOffset = FixEntry.FunctionEntryOffset;
+        }
+        if (FixEntry.FunctionEntryOffset + (uint32_t) sizeof(void*) > EndSlotOffset) {
+            EndSlotOffset = FixEntry.FunctionEntryOffset + (uint32_t) sizeof(void*);
+        }
+    }
+    DWORD OldProtection;
+    if (!VirtualProtect(TableStart + FirstSlotOffset, EndSlotOffset - FirstSlotOffset, PAGE_READWRITE, &OldProtection)) {
+        return false;
+    }
+    PatchedInPlaceTableSizes[TableStart] = MeasuredSize;
+    for (const VTableFixEntry& FixEntry : FixEntries) {
+        //Original is published before the slot, since hook can be called as soon as slot is written
+        auto* FunctionPointer = (void* volatile*) (TableStart + FixEntry.FunctionEntryOffset);
+        *FixEntry.OutOriginalFunctionPtr = *FunctionPointer;
+        *FunctionPointer = FixEntry.FunctionToCallInstead;
+    }
+    VirtualProtect(TableStart + FirstSlotOffset, EndSlotOffset - FirstSlotOffset, OldProtection, &OldProtection);
+    return true;
 }
 
 void ApplyConstructorFixes(void* ThisPointer, ConstructorFixInfo* FixInfo) {
+    const VTableDefinitionList* DefinitionList = FixInfo->Fixes.load(std::memory_order_acquire);
+    if (DefinitionList == nullptr) {
+        return;
+    }
     uint8_t* OffsetPointer = (uint8_t*) ThisPointer;
-    for (VTableDefinition& Definition : FixInfo->Fixes) {
-        uint32_t OriginOffset = Definition.VirtualTableOriginOffset;
+    for (VTableDefinition* Definition : DefinitionList->Definitions) {
+        uint32_t OriginOffset = Definition->VirtualTableOriginOffset;
         uint8_t** VirtualTableField = (uint8_t**) (OffsetPointer + OriginOffset);
         uint8_t* VirtualTablePointer = *VirtualTableField;
-        uint8_t* NewVirtualTablePointer = CreateAndCacheVirtualTable(VirtualTablePointer, Definition);
-        *VirtualTableField = NewVirtualTablePointer;
+        //Constructor almost always sees the same table, so it is compared against the last patched one first
+        const PatchedVirtualTable* PatchedTable = Definition->LastPatchedTable.load(std::memory_order_acquire);
+        if (PatchedTable == nullptr || PatchedTable->OriginalTable != VirtualTablePointer) {
+            std::lock_guard Guard(VirtualTableCacheMutex);
+            PatchedTable = CreateAndCacheVirtualTableLocked(VirtualTablePointer, *Definition);
+        }
+        *VirtualTableField = PatchedTable->PatchedTable;
     }
 }
@@ -1,7 +1,10 @@
 #ifndef XINPUT_1_3_VTABLEFIXHELPER_H
 #define XINPUT_1_3_VTABLEFIXHELPER_H
 #include "SymbolResolver.h"
+#include "DestructorGenerator.h"
 #include <vector>
+#include <unordered_map>
+#include <atomic>
 
 struct VTableFixEntry {
     unsigned int FunctionEntryOffset;
@@ -9,16 +12,75 @@ struct VTableFixEntry {
     void** OutOriginalFunctionPtr;
 };
 
+/** Clone of the original virtual table with overrides applied. Never freed, objects keep pointing to it */
+struct PatchedVirtualTable {
+    uint8_t* OriginalTable;
+    uint8_t* PatchedTable;
+};
+
 struct VTableDefinition {
-    unsigned int VirtualTableOriginOffset;
+    const unsigned int VirtualTableOriginOffset;
+    //fields below are only accessed with the virtual table cache lock held
     bool bFlushCaches;
     std::vector<VTableFixEntry> FixEntries;
+    //tables patched with fixes of this definition, keyed by the original table they were cloned from
+    //only consulted when constructor sees a table it didn't patch last time, or after the flush
+    std::unordered_map<uint8_t*, const PatchedVirtualTable*> CachedTables;
+    //original table registered by the module, patched table for it is built ahead of the first constructor call
+    uint8_t* RegisteredOriginalTable;
+    //table patched by the last constructor call, so constructors don't need to look it up while it stays the same
+    //read by constructors without the lock, but only published with it held
+    std::atomic<const PatchedVirtualTable*> LastPatchedTable;
+
+    explicit VTableDefinition(unsigned int VirtualTableOriginOffset) :
+        VirtualTableOriginOffset(VirtualTableOriginOffset), bFlushCaches(false), RegisteredOriginalTable(nullptr), LastPatchedTable(nullptr) {}
+};
+
+/** Immutable list of definitions, replaced as a whole when definition is added */
+struct VTableDefinitionList {
+    std::vector<VTableDefinition*> Definitions;
 };
 
 struct ConstructorFixInfo {
-    std::vector<VTableDefinition> Fixes;
+    //constructors iterate the list without the lock, so neither lists nor definitions are ever freed
+    std::atomic<const VTableDefinitionList*> Fixes{nullptr};
 };
 
+/**
+ * Records executable sections of the game image, which are used to measure virtual tables before cloning them
+ * Should be called before any constructor fixes are applied
+ */
+void InitializeVirtualTableSizing(const void* GameImageBase);
+
+/** Adds override of the virtual table slot, tables patched before are rebuilt on the next constructor call */
+void AddVirtualTableFix(ConstructorFixInfo* FixInfo, unsigned int VirtualTableOriginOffset, const VTableFixEntry& FixEntry);
+
+/**
+ * Records original virtual table installed by the constructor at the given offset, see BuildRegisteredVirtualTables
+ * Returns false if the table is not in the read-only data of the game image
+ */
+bool RegisterOriginalVirtualTable(ConstructorFixInfo* FixInfo, unsigned int VirtualTableOriginOffset, void* OriginalTable);
+
+/**
+ * Builds patched tables for all registered original tables, so constructors only install precomputed pointers
+ * Fixes added after that are still applied, but their tables are built by the next constructor call
+ * @return amount of patched tables built
+ */
+uint32_t BuildRegisteredVirtualTables();
+
+/**
+ * Retrieves patched tables built for all definitions of the constructor, see BuildRegisteredVirtualTables
+ * @return false if any of the definitions doesn't have registered original table or its patched table is out of date
+ */
+bool GetPrecomputedVirtualTables(ConstructorFixInfo* FixInfo, std::vector<PrecomputedVirtualTable>& OutVirtualTables);
+
+/**
+ * Overrides slots of the original virtual table in place, so the hooks apply to all objects, including existing ones
+ * Protection of the table memory is changed once for all slots. Tables cloned before keep their old slots
+ * @return false without patching anything if table is not in the read-only data of the game image or slots are past its measured end
+ */
+bool PatchVirtualTableInPlace(void* VirtualTable, const std::vector<VTableFixEntry>& FixEntries);
+
 void ApplyConstructorFixes(void* ThisPointer, ConstructorFixInfo* FixInfo);
 
 #endif //XINPUT_1_3_VTABLEFIXHELPER_H
@@ -0,0 +1,78 @@
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool(uint32_t WorkerCount) : CurrentTask(nullptr), TaskCount(0), NextTaskIndex(0),
+    FinishedTaskCount(0), ActiveWorkerCount(0), Generation(0), bShuttingDown(false) {
+    for (uint32_t i = 0; i < WorkerCount; i++) {
+        Workers.emplace_back(&WorkerPool::WorkerThreadMain, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard Guard(Mutex);
+        bShuttingDown = true;
+    }
+    WorkAvailable.notify_all();
+    for (std::thread& Worker : Workers) {
+        Worker.join();
+    }
+}
+
+void WorkerPool::ParallelFor(size_t Count, const std::function<void(size_t)>& Task) {
+    if (Workers.empty() || Count <= 1) {
+        for (size_t i = 0; i < Count; i++) {
+            Task(i);
+        }
+        return;
+    }
+    {
+        std::lock_guard Guard(Mutex);
+        CurrentTask = &Task;
+        TaskCount = Count;
+        NextTaskIndex.store(0);
+        FinishedTaskCount = 0;
+        Generation++;
+    }
+    WorkAvailable.notify_all();
+    const size_t ExecutedTaskCount = ExecuteTasks(Task, Count);
+
+    std::unique_lock Guard(Mutex);
+    FinishedTaskCount += ExecutedTaskCount;
+    WorkFinished.wait(Guard, [&] { return FinishedTaskCount == TaskCount && ActiveWorkerCount == 0; });
+    CurrentTask = nullptr;
+}
+
+size_t WorkerPool::ExecuteTasks(const std::function<void(size_t)>& Task, size_t Count) {
+    size_t ExecutedTaskCount = 0;
+    for (size_t Index = NextTaskIndex.fetch_add(1); Index < Count; Index = NextTaskIndex.fetch_add(1)) {
+        Task(Index);
+        ExecutedTaskCount++;
+    }
+    return ExecutedTaskCount;
+}
+
+void WorkerPool::WorkerThreadMain() {
+    uint64_t LastGeneration = 0;
+    while (true) {
+        const std::function<void(size_t)>* Task;
+        size_t Count;
+        {
+            std::unique_lock Guard(Mutex);
+            WorkAvailable.wait(Guard, [&] { return bShuttingDown || (Generation != LastGeneration && CurrentTask != nullptr); });
+            if (bShuttingDown) {
+                return;
+            }
+            LastGeneration = Generation;
+            ActiveWorkerCount++;
+            Task = CurrentTask;
+            Count = TaskCount;
+        }
+        const size_t ExecutedTaskCount = ExecuteTasks(*Task, Count);
+        {
+            std::lock_guard Guard(Mutex);
+            FinishedTaskCount += ExecutedTaskCount;
+            ActiveWorkerCount--;
+        }
+        WorkFinished.notify_all();
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef XINPUT1_3_WORKERPOOL_H
+#define XINPUT1_3_WORKERPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of threads executing index ranges in parallel
+ * Calling thread always takes part in the work, so the pool with zero workers runs everything inline
+ * Worker threads can't start while the loader lock is held, so the pool must not be used from DllMain
+ */
+class WorkerPool {
+private:
+    std::vector<std::thread> Workers;
+    std::mutex Mutex;
+    std::condition_variable WorkAvailable;
+    std::condition_variable WorkFinished;
+    //task of the current ParallelFor call, valid while it is running
+    const std::function<void(size_t)>* CurrentTask;
+    size_t TaskCount;
+    std::atomic<size_t> NextTaskIndex;
+    size_t FinishedTaskCount;
+    //workers that picked up the current task, ParallelFor waits for them so they never see a stale task
+    uint32_t ActiveWorkerCount;
+    uint64_t Generation;
+    bool bShuttingDown;
+public:
+    explicit WorkerPool(uint32_t WorkerCount);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    inline uint32_t GetWorkerCount() const { return (uint32_t) Workers.size(); }
+
+    /** Calls Task for each index in [0, Count) and waits until all calls have finished. Not reentrant */
+    void ParallelFor(size_t Count, const std::function<void(size_t)>& Task);
+private:
+    void WorkerThreadMain();
+    /** Executes tasks until none are left, returns number of executed tasks */
+    size_t ExecuteTasks(const std::function<void(size_t)>& Task, size_t Count);
+};
+
+#endif //XINPUT1_3_WORKERPOOL_H
@@ -0,0 +1,49 @@
+#include "config.h"
+#include "logging.h"
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <cwctype>
+
+namespace Config {
+    bool releaseDiaAfterBootstrap = false;
+    bool bootstrapOnDedicatedThread = false;
+    bool lazyImportBinding = false;
+    bool parallelModuleBootstrap = false;
+    static bool bConfigInitialized = false;
+
+    //command line is split on whitespace manually instead of using CommandLineToArgvW,
+    //because it lives in shell32.dll which cannot be safely loaded from DllMain
+    static bool hasCommandLineSwitch(const wchar_t* switchName) {
+        const size_t switchLength = wcslen(switchName);
+        const wchar_t* argument = GetCommandLineW();
+        while (*argument != L'\0') {
+            const wchar_t* argumentEnd = argument;
+            while (*argumentEnd != L'\0' && !iswspace(*argumentEnd)) {
+                argumentEnd++;
+            }
+            if ((size_t) (argumentEnd - argument) == switchLength && _wcsnicmp(argument, switchName, switchLength) == 0) {
+                return true;
+            }
+            argument = argumentEnd;
+            while (*argument != L'\0' && iswspace(*argument)) {
+                argument++;
+            }
+        }
+        return false;
+    }
+
+    void initializeConfig() {
+        if (bConfigInitialized) {
+            return;
+        }
+        bConfigInitialized = true;
+        releaseDiaAfterBootstrap = hasCommandLineSwitch(L"-BootstrapperReleaseDia");
+        bootstrapOnDedicatedThread = hasCommandLineSwitch(L"-BootstrapperThread");
+        lazyImportBinding = hasCommandLineSwitch(L"-BootstrapperLazyImports");
+        parallelModuleBootstrap = hasCommandLineSwitch(L"-BootstrapperParallelModules");
+        Logging::logFile << "Release DIA after bootstrap: " << releaseDiaAfterBootstrap << std::endl;
+        Logging::logFile << "Bootstrap on dedicated thread: " << bootstrapOnDedicatedThread << std::endl;
+        Logging::logFile << "Lazy import binding: " << lazyImportBinding << std::endl;
+        Logging::logFile << "Parallel module bootstrap: " << parallelModuleBootstrap << std::endl;
+    }
+}
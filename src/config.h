@@ -0,0 +1,21 @@
+#ifndef XINPUT1_3_CONFIG_H
+#define XINPUT1_3_CONFIG_H
+
+/**
+ * Bootstrapper settings, controlled by the switches on the game command line
+ */
+namespace Config {
+    //-BootstrapperReleaseDia: release DIA session after bootstrapping loader modules
+    extern bool releaseDiaAfterBootstrap;
+    //-BootstrapperThread: bootstrap loader modules on a dedicated thread from the game entry point, outside of the loader lock
+    extern bool bootstrapOnDedicatedThread;
+    //-BootstrapperLazyImports: bind game function imports of loader modules on their first call
+    extern bool lazyImportBinding;
+    //-BootstrapperParallelModules: call BootstrapModule of independent loader modules concurrently, requires -BootstrapperThread
+    extern bool parallelModuleBootstrap;
+
+    /** Reads switches from the command line. Safe to call from DllMain, only first call has any effect */
+    void initializeConfig();
+}
+
+#endif //XINPUT1_3_CONFIG_H
@@ -4,26 +4,44 @@
 #include "DllLoader.h"
 #include <filesystem>
 #include <mutex>
+#include <thread>
+#include <chrono>
+#include <string_view>
 #include <map>
+#include <sstream>
 #include "exports.h"
 #include "util.h"
 #include "DestructorGenerator.h"
 #include "VTableFixHelper.h"
 #include "AssemblyAnalyzer.h"
+#include "config.h"
+#include "DependencyGraph.h"
+#include "WorkerPool.h"
+#include <psapi.h>
 
 using namespace std::filesystem;
 
 #define GAME_MODULE_NAME "FactoryGame-Win64-Shipping.exe"
 
 static DllLoader* dllLoader;
+static SymbolResolver* symbolResolver;
+//loader modules can be bootstrapped concurrently, but loading modules and their debug symbols is not thread safe
+static std::mutex moduleLoaderMutex;
+//set when bootstrapping from the game entry point, where loader lock is not held and worker threads can be used
+static bool bootstrapOutsideLoaderLock = false;
+//upper bound of the import resolution worker threads, more don't help since misses are generated one at a time
+#define MAX_IMPORT_WORKER_THREADS 8
+//loader modules mostly wait on each other through their dependencies, so a few threads are enough
+#define MAX_BOOTSTRAP_WORKER_THREADS 4
 
-extern "C" __declspec(dllexport) const wchar_t* bootstrapperVersion = L"2.0.11";
+extern "C" __declspec(dllexport) const wchar_t* bootstrapperVersion = L"2.1.0";
 
 bool EXPORTS_IsLoaderModuleLoaded(const char* moduleName) {
     return GetModuleHandleA(moduleName) != nullptr;
 }
 
 void* EXPORTS_LoadModule(const char*, const wchar_t* filePath) {
+    std::lock_guard guard(moduleLoaderMutex);
     return dllLoader->LoadModule(filePath);
 }
 
@@ -39,11 +57,30 @@ SymbolDigestInfo EXPORTS_DigestGameSymbol(const wchar_t* SymbolName) {
     return dllLoader->resolver->DigestGameSymbol(SymbolName);
 }
 
+unsigned long long EXPORTS_DigestGameSymbols(const wchar_t* const* SymbolNames, unsigned long long SymbolCount, SymbolDigestInfo* OutDigestInfos, wchar_t* StringArena, unsigned long long StringArenaSize) {
+    return dllLoader->resolver->DigestGameSymbols(SymbolNames, SymbolCount, OutDigestInfos, StringArena, StringArenaSize);
+}
+
+//generic thunk can be redirected to the thunk specialized for its virtual tables, see specializeConstructorHookThunks
+struct ConstructorHookThunkState {
+    ConstructorCallbackEntry* CallbackEntry;
+    OpaqueFunctionPtr GenericThunk;
+    bool bSpecialized;
+    uint64_t GenericThunkPrologue;
+};
+static std::mutex constructorHookThunksMutex;
+static std::vector<ConstructorHookThunkState> constructorHookThunks;
+
 ConstructorHookThunk EXPORTS_CreateConstructorHookThunkFunc() {
-    auto* CallbackEntry = new ConstructorCallbackEntry;
+    auto* CallbackEntry = new ConstructorCallbackEntry{};
     CallbackEntry->CallProcessor = (void*) &ApplyConstructorFixes;
     CallbackEntry->UserData = new ConstructorFixInfo{};
-    void* GeneratedThunk = (void*) dllLoader->resolver->destructorGenerator->GenerateConstructorPatchEntry(CallbackEntry);
+    OpaqueFunctionPtr GenericThunk = dllLoader->resolver->destructorGenerator->GenerateConstructorPatchEntry(CallbackEntry);
+    void* GeneratedThunk = (void*) GenericThunk;
+    {
+        std::lock_guard Guard(constructorHookThunksMutex);
+        constructorHookThunks.push_back(ConstructorHookThunkState{CallbackEntry, GenericThunk, false, 0});
+    }
     ConstructorHookThunk HookThunk{};
     HookThunk.OpaquePointer = CallbackEntry;
     HookThunk.OutTrampolineAddress = &CallbackEntry->TrampolineFunctionAddress;
@@ -76,32 +113,82 @@ bool EXPORTS_AddConstructorHook(ConstructorHookThunk ConstructorThunk, VirtualFu
     auto* FixInfo = reinterpret_cast<ConstructorFixInfo*>(CallbackEntry->UserData);
     MemberFunctionInfo FunctionInfo = DigestMemberFunctionPointer(HookInfo.PointerInfo.MemberFunctionPointer, HookInfo.PointerInfo.MemberFunctionPointerSize);
     if (FunctionInfo.bIsVirtualFunctionThunk) {
-        VTableDefinition* TableDefinition = nullptr;
-        for (VTableDefinition& FixEntry : FixInfo->Fixes) {
-            if (FixEntry.VirtualTableOriginOffset == FunctionInfo.ThisAdjustment) {
-                TableDefinition = &FixEntry; break;
+        VTableFixEntry FixEntry{};
+        FixEntry.FunctionEntryOffset = FunctionInfo.VirtualTableOffset;
+        FixEntry.FunctionToCallInstead = HookInfo.FunctionToCallInstead;
+        FixEntry.OutOriginalFunctionPtr = HookInfo.OutOriginalFunctionPtr;
+        AddVirtualTableFix(FixInfo, FunctionInfo.ThisAdjustment, FixEntry);
+        //specialized thunk installs tables built before this fix, so generic one is used from now on
+        std::lock_guard Guard(constructorHookThunksMutex);
+        for (ConstructorHookThunkState& ThunkState : constructorHookThunks) {
+            if (ThunkState.CallbackEntry == CallbackEntry && ThunkState.bSpecialized) {
+                dllLoader->resolver->destructorGenerator->RestoreGeneratedFunction(ThunkState.GenericThunk, ThunkState.GenericThunkPrologue);
+                ThunkState.bSpecialized = false;
             }
         }
-        if (TableDefinition == nullptr) {
-            FixInfo->Fixes.push_back(VTableDefinition{FunctionInfo.ThisAdjustment});
-            TableDefinition = &FixInfo->Fixes[FixInfo->Fixes.size() - 1];
+        return true;
+    }
+    return false;
+}
+
+bool EXPORTS_RegisterConstructorVirtualTable(ConstructorHookThunk ConstructorThunk, unsigned int VirtualTableOffset, void* OriginalVirtualTable) {
+    if (ConstructorThunk.OpaquePointer == nullptr || OriginalVirtualTable == nullptr) {
+        return false;
+    }
+    auto* CallbackEntry = reinterpret_cast<ConstructorCallbackEntry*>(ConstructorThunk.OpaquePointer);
+    return RegisterOriginalVirtualTable(reinterpret_cast<ConstructorFixInfo*>(CallbackEntry->UserData), VirtualTableOffset, OriginalVirtualTable);
+}
+
+bool EXPORTS_PatchVirtualTable(void* VirtualTable, const VirtualFunctionHookInfo* HookInfos, unsigned long long HookCount) {
+    std::vector<VTableFixEntry> FixEntries;
+    for (unsigned long long i = 0; i < HookCount; i++) {
+        const VirtualFunctionHookInfo& HookInfo = HookInfos[i];
+        MemberFunctionInfo FunctionInfo = DigestMemberFunctionPointer(HookInfo.PointerInfo.MemberFunctionPointer, HookInfo.PointerInfo.MemberFunctionPointerSize);
+        if (!FunctionInfo.bIsVirtualFunctionThunk) {
+            return false;
         }
-        TableDefinition->bFlushCaches = true;
         VTableFixEntry FixEntry{};
         FixEntry.FunctionEntryOffset = FunctionInfo.VirtualTableOffset;
         FixEntry.FunctionToCallInstead = HookInfo.FunctionToCallInstead;
         FixEntry.OutOriginalFunctionPtr = HookInfo.OutOriginalFunctionPtr;
-        TableDefinition->FixEntries.push_back(FixEntry);
-        return true;
+        FixEntries.push_back(FixEntry);
     }
-    return false;
+    return PatchVirtualTableInPlace(VirtualTable, FixEntries);
+}
+
+/**
+ * Redirects generic constructor hook thunks to the thunks generated for their final virtual tables,
+ * which install precomputed tables directly instead of going through ApplyConstructorFixes
+ * @return amount of specialized thunks
+ */
+uint32_t specializeConstructorHookThunks() {
+    DestructorGenerator* generator = dllLoader->resolver->destructorGenerator;
+    std::lock_guard guard(constructorHookThunksMutex);
+    uint32_t specializedThunkCount = 0;
+    for (ConstructorHookThunkState& thunkState : constructorHookThunks) {
+        std::vector<PrecomputedVirtualTable> virtualTables;
+        ConstructorCallbackEntry* callbackEntry = thunkState.CallbackEntry;
+        //trampoline is only known once the module has hooked the constructor
+        if (thunkState.bSpecialized || callbackEntry->TrampolineFunctionAddress == nullptr ||
+            !GetPrecomputedVirtualTables(reinterpret_cast<ConstructorFixInfo*>(callbackEntry->UserData), virtualTables)) {
+            continue;
+        }
+        OpaqueFunctionPtr specializedThunk = generator->GenerateSpecializedConstructorPatchEntry(callbackEntry, virtualTables);
+        if (generator->RedirectGeneratedFunction(thunkState.GenericThunk, specializedThunk, thunkState.GenericThunkPrologue)) {
+            thunkState.bSpecialized = true;
+            specializedThunkCount++;
+        }
+    }
+    return specializedThunkCount;
 }
 
 void EXPORTS_FlushDebugSymbols() {
+    std::lock_guard guard(moduleLoaderMutex);
     dllLoader->FlushDebugSymbols();
 }
 
 wchar_t* EXPORTS_GetSymbolFileRoots(void*(*Malloc)(uint64_t)) {
+    std::lock_guard Guard(moduleLoaderMutex);
     std::wstring Result;
     for (const std::wstring& RootDirectory : dllLoader->pdbRootDirectories) {
         Result.append(RootDirectory);
@@ -122,46 +209,217 @@ std::string GetLastErrorAsString();
 void discoverLoaderMods(std::map<std::string, HMODULE>& discoveredModules, const std::filesystem::path& rootGameDirectory) {
     std::filesystem::path directoryPath = rootGameDirectory / "loaders";
     std::filesystem::create_directories(directoryPath);
+    std::vector<std::filesystem::path> modulePaths;
     for (auto& file : std::filesystem::directory_iterator(directoryPath)) {
         if (file.is_regular_file() && file.path().extension() == ".dll") {
-            Logging::logFile << "Discovering loader module candidate tetest " << file.path().filename() << std::endl;
-            HMODULE loadedModule = dllLoader->LoadModule(file.path().wstring().c_str());
-            if (loadedModule != nullptr) {
-                Logging::logFile << "Successfully loaded module " << file.path().filename() << std::endl;
-                discoveredModules.insert({file.path().filename().string(), loadedModule});
-            } else {
-                Logging::logFile << "Failed to load module " << file.path().filename() << ": " << std::endl;
-                Logging::logFile << "Last Error Message: " << GetLastErrorAsString() << std::endl;
-                exit(1);
+            Logging::logFile << "Discovering loader module candidate " << file.path().filename() << std::endl;
+            modulePaths.push_back(file.path());
+        }
+    }
+    //load all modules together so their game symbol imports are resolved in one pass
+    std::vector<HMODULE> loadedModules = dllLoader->LoadModules(modulePaths);
+    for (size_t i = 0; i < modulePaths.size(); i++) {
+        const std::filesystem::path& modulePath = modulePaths[i];
+        if (loadedModules[i] != nullptr) {
+            Logging::logFile << "Successfully loaded module " << modulePath.filename() << std::endl;
+            discoveredModules.insert({modulePath.filename().string(), loadedModules[i]});
+        } else {
+            Logging::logFile << "Failed to load module " << modulePath.filename() << ": " << std::endl;
+            Logging::logFile << "Last Error Message: " << GetLastErrorAsString() << std::endl;
+            exit(1);
+        }
+    }
+}
+
+static std::string toLowerAscii(std::string string) {
+    for (char& character : string) {
+        if (character >= 'A' && character <= 'Z') {
+            character = (char) (character - 'A' + 'a');
+        }
+    }
+    return string;
+}
+
+/** Collects indices of loader modules which should be bootstrapped before the given one */
+static std::vector<size_t> collectModuleDependencies(const std::string& moduleName, HMODULE module, const std::vector<std::string>& lowerCaseModuleNames) {
+    std::vector<size_t> dependencies;
+    auto addDependency = [&](std::string_view dependencyName, bool bExplicitDependency) {
+        const std::string lowerCaseName = toLowerAscii(std::string(dependencyName));
+        for (size_t i = 0; i < lowerCaseModuleNames.size(); i++) {
+            if (lowerCaseModuleNames[i] == lowerCaseName) {
+                dependencies.push_back(i);
+                return;
+            }
+        }
+        if (bExplicitDependency) {
+            Logging::logFile << "[WARNING] Loader module " << moduleName << " depends on missing module " << lowerCaseName << std::endl;
+        }
+    };
+    //importing another loader module means depending on it
+    PeImage image;
+    if (image.OpenLoadedImage(module)) {
+        image.ForEachImportDescriptor([&](const PeImportDescriptor& descriptor) {
+            addDependency(descriptor.LibraryName, false);
+            return true;
+        });
+    }
+    auto getDependencies = (GetBootstrapDependenciesFunc) GetProcAddress(module, "GetBootstrapDependencies");
+    const char* declaredDependencies = getDependencies != nullptr ? getDependencies() : nullptr;
+    if (declaredDependencies != nullptr) {
+        std::string_view remainingDependencies = declaredDependencies;
+        while (!remainingDependencies.empty()) {
+            const size_t separatorIndex = remainingDependencies.find(BOOTSTRAP_DEPENDENCY_SEPARATOR);
+            const std::string_view dependencyName = remainingDependencies.substr(0, separatorIndex);
+            if (!dependencyName.empty()) {
+                addDependency(dependencyName, true);
             }
+            remainingDependencies = separatorIndex == std::string_view::npos ? std::string_view() : remainingDependencies.substr(separatorIndex + 1);
         }
     }
+    return dependencies;
 }
 
 void bootstrapLoaderMods(const std::map<std::string, HMODULE>& discoveredModules, const std::wstring& gameRootDirectory) {
+    std::vector<std::string> moduleNames;
+    std::vector<std::string> lowerCaseModuleNames;
+    std::vector<BootstrapModuleFunc> bootstrapFunctions;
     for (auto& loaderModule : discoveredModules) {
-        FUNCTION_PTR bootstrapFunc = GetProcAddress(loaderModule.second, "BootstrapModule");
+        auto bootstrapFunc = (BootstrapModuleFunc) GetProcAddress(loaderModule.second, "BootstrapModule");
         if (bootstrapFunc == nullptr) {
             Logging::logFile << "[WARNING]: BootstrapModule() not found in loader module " << loaderModule.first << "!" << std::endl;
-            return;
         }
-        BootstrapAccessors accessors{
-            gameRootDirectory.c_str(),
-            &EXPORTS_LoadModule,
-            &EXPORTS_GetModuleProcAddress,
-            &EXPORTS_IsLoaderModuleLoaded,
-            &EXPORTS_ResolveModuleSymbol,
-            bootstrapperVersion,
-            &EXPORTS_FlushDebugSymbols,
-            &EXPORTS_GetSymbolFileRoots,
-            &EXPORTS_DigestGameSymbol,
-            &EXPORTS_CreateConstructorHookThunkFunc,
-            &EXPORTS_AddConstructorHook,
-            &EXPORTS_DigestMemberFunctionPointer
-        };
-        Logging::logFile << "Bootstrapping module " << loaderModule.first << std::endl;
-        ((BootstrapModuleFunc) bootstrapFunc)(accessors);
+        moduleNames.push_back(loaderModule.first);
+        lowerCaseModuleNames.push_back(toLowerAscii(loaderModule.first));
+        bootstrapFunctions.push_back(bootstrapFunc);
     }
+    //modules are still bootstrapped in alphabetical order, unless it conflicts with their dependencies
+    std::vector<std::vector<size_t>> moduleDependencies;
+    for (auto& loaderModule : discoveredModules) {
+        moduleDependencies.push_back(collectModuleDependencies(loaderModule.first, loaderModule.second, lowerCaseModuleNames));
+        for (size_t dependency : moduleDependencies.back()) {
+            Logging::logFile << "Loader module " << loaderModule.first << " depends on " << moduleNames[dependency] << std::endl;
+        }
+    }
+
+    //worker threads can't start under the loader lock
+    uint32_t bootstrapWorkerThreadCount = 0;
+    if (Config::parallelModuleBootstrap && bootstrapOutsideLoaderLock) {
+        const uint32_t hardwareThreadCount = std::thread::hardware_concurrency();
+        bootstrapWorkerThreadCount = hardwareThreadCount > MAX_BOOTSTRAP_WORKER_THREADS ? MAX_BOOTSTRAP_WORKER_THREADS : (hardwareThreadCount > 1 ? hardwareThreadCount - 1 : 0);
+        Logging::logFile << "Bootstrapping independent loader modules on " << bootstrapWorkerThreadCount << " worker threads" << std::endl;
+    } else if (Config::parallelModuleBootstrap) {
+        Logging::logFile << "[WARNING] Parallel module bootstrap requires bootstrapping from the game entry point, bootstrapping serially" << std::endl;
+    }
+    //levels are only needed to run modules concurrently, serial bootstrap keeps alphabetical order wherever dependencies allow
+    std::vector<std::vector<size_t>> bootstrapLevels;
+    bool bDependenciesAcyclic;
+    if (bootstrapWorkerThreadCount > 0) {
+        bDependenciesAcyclic = ComputeDependencyLevels(moduleDependencies, bootstrapLevels);
+    } else {
+        std::vector<size_t> bootstrapOrder;
+        bDependenciesAcyclic = ComputeDependencyOrder(moduleDependencies, bootstrapOrder);
+        for (size_t module : bootstrapOrder) {
+            bootstrapLevels.push_back({module});
+        }
+    }
+    if (!bDependenciesAcyclic) {
+        Logging::logFile << "[WARNING] Loader module dependencies are cyclic, modules in the cycle are bootstrapped in alphabetical order" << std::endl;
+    }
+
+    WorkerPool bootstrapPool(bootstrapWorkerThreadCount);
+    std::vector<double> bootstrapMilliseconds(moduleNames.size());
+    //modules bootstrapped concurrently log into their own buffers, which are written into the log in module order
+    std::vector<std::ostringstream> moduleLogs(bootstrapWorkerThreadCount > 0 ? moduleNames.size() : 0);
+    for (const std::vector<size_t>& bootstrapLevel : bootstrapLevels) {
+        for (size_t module : bootstrapLevel) {
+            if (bootstrapFunctions[module] != nullptr) {
+                Logging::logFile << "Bootstrapping module " << moduleNames[module] << std::endl;
+            }
+        }
+        bootstrapPool.ParallelFor(bootstrapLevel.size(), [&](size_t i) {
+            const size_t module = bootstrapLevel[i];
+            if (bootstrapFunctions[module] == nullptr) {
+                return;
+            }
+            BootstrapAccessors accessors{
+                gameRootDirectory.c_str(),
+                &EXPORTS_LoadModule,
+                &EXPORTS_GetModuleProcAddress,
+                &EXPORTS_IsLoaderModuleLoaded,
+                &EXPORTS_ResolveModuleSymbol,
+                bootstrapperVersion,
+                &EXPORTS_FlushDebugSymbols,
+                &EXPORTS_GetSymbolFileRoots,
+                &EXPORTS_DigestGameSymbol,
+                &EXPORTS_CreateConstructorHookThunkFunc,
+                &EXPORTS_AddConstructorHook,
+                &EXPORTS_DigestMemberFunctionPointer,
+                &EXPORTS_DigestGameSymbols,
+                &EXPORTS_RegisterConstructorVirtualTable,
+                &EXPORTS_PatchVirtualTable
+            };
+            if (!moduleLogs.empty()) {
+                Logging::setThreadLogBuffer(&moduleLogs[module]);
+            }
+            const auto startTime = std::chrono::steady_clock::now();
+            bootstrapFunctions[module](accessors);
+            const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - startTime;
+            bootstrapMilliseconds[module] = duration.count();
+            Logging::setThreadLogBuffer(nullptr);
+        });
+        for (size_t module : bootstrapLevel) {
+            if (!moduleLogs.empty()) {
+                Logging::logFile << moduleLogs[module].str();
+            }
+            if (bootstrapFunctions[module] != nullptr) {
+                Logging::logFile << "Bootstrapped module " << moduleNames[module] << " in " << bootstrapMilliseconds[module] << " ms" << std::endl;
+            }
+        }
+    }
+}
+
+void logCacheCounters(const char* cacheName, const CacheCounters& counters) {
+    Logging::logFile << cacheName << " cache: " << counters.Hits.load() << " hits, " << counters.Misses.load() << " misses" << std::endl;
+}
+
+void logProcessMemoryUsage(const char* stageName) {
+    PROCESS_MEMORY_COUNTERS_EX memoryCounters{};
+    GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&memoryCounters), sizeof(memoryCounters));
+    Logging::logFile << "Process memory " << stageName << ": Working Set " << memoryCounters.WorkingSetSize / (1024 * 1024) << " MB, ";
+    Logging::logFile << "Private Bytes " << memoryCounters.PrivateUsage / (1024 * 1024) << " MB" << std::endl;
+}
+
+SymbolResolver* createSymbolResolver(HMODULE gameModule, HMODULE selfModuleHandle) {
+    path bootstrapperDirectory = path(getModuleFileName(selfModuleHandle)).parent_path();
+    path diaDllPath = bootstrapperDirectory / "msdia140.dll";
+    path symbolIndexPath = bootstrapperDirectory / "symbol-index.bin";
+    //TODO strict mode where missing symbols result in aborting?
+    return new SymbolResolver(gameModule, diaDllPath, false, symbolIndexPath);
+}
+
+DWORD WINAPI symbolWarmupThreadProc(LPVOID resolver) {
+    reinterpret_cast<SymbolResolver*>(resolver)->WarmUpSymbolIndex();
+    return 0;
+}
+
+DWORD startSymbolWarmup(HMODULE selfModuleHandle) {
+    HMODULE gameModule = GetModuleHandleA(GAME_MODULE_NAME);
+    if (gameModule == nullptr) {
+        //setupExecutableHook will report it later
+        return 0;
+    }
+    Logging::initializeLogging();
+    symbolResolver = createSymbolResolver(gameModule, selfModuleHandle);
+    //thread will only start running once the loader lock is released, which is fine since it doesn't need anything from us
+    DWORD threadId = 0;
+    HANDLE threadHandle = CreateThread(nullptr, 0, &symbolWarmupThreadProc, symbolResolver, 0, &threadId);
+    if (threadHandle == nullptr) {
+        Logging::logFile << "[WARNING] Failed to start symbol warm-up thread: " << GetLastErrorAsString() << std::endl;
+        return 0;
+    }
+    CloseHandle(threadHandle);
+    Logging::logFile << "Started symbol warm-up thread" << std::endl;
+    return threadId;
 }
 
 static std::mutex setupHookMutex;
@@ -181,6 +439,77 @@ std::filesystem::path resolveGameRootDir() {
     return rootDirPath;
 }
 
+//absolute indirect jump: jmp qword ptr [rip+0], followed by the target address
+#define ENTRY_POINT_PATCH_SIZE 14
+
+typedef DWORD (WINAPI *GameEntryPointFunc)(LPVOID processEnvironmentBlock);
+
+static HMODULE bootstrapperModuleHandle;
+static GameEntryPointFunc gameEntryPoint;
+static uint8_t originalEntryPointBytes[ENTRY_POINT_PATCH_SIZE];
+static HANDLE bootstrapFinishedEvent;
+
+static void writeEntryPointBytes(const uint8_t* bytes) {
+    DWORD oldProtection;
+    VirtualProtect((LPVOID) gameEntryPoint, ENTRY_POINT_PATCH_SIZE, PAGE_EXECUTE_READWRITE, &oldProtection);
+    memcpy((void*) gameEntryPoint, bytes, ENTRY_POINT_PATCH_SIZE);
+    VirtualProtect((LPVOID) gameEntryPoint, ENTRY_POINT_PATCH_SIZE, oldProtection, &oldProtection);
+    FlushInstructionCache(GetCurrentProcess(), (LPCVOID) gameEntryPoint, ENTRY_POINT_PATCH_SIZE);
+}
+
+DWORD WINAPI bootstrapThreadProc(LPVOID) {
+    setupExecutableHook(bootstrapperModuleHandle);
+    //let the game continue now that all loader modules are bootstrapped
+    SetEvent(bootstrapFinishedEvent);
+    return 0;
+}
+
+DWORD WINAPI gameEntryPointHook(LPVOID processEnvironmentBlock) {
+    //loader lock is released by now, restore original entry point and bootstrap before running it
+    writeEntryPointBytes(originalEntryPointBytes);
+    bootstrapOutsideLoaderLock = true;
+    Logging::logFile << "Game entry point reached, bootstrapping on dedicated thread" << std::endl;
+    HANDLE threadHandle = CreateThread(nullptr, 0, &bootstrapThreadProc, nullptr, 0, nullptr);
+    if (threadHandle == nullptr) {
+        Logging::logFile << "[WARNING] Failed to start bootstrap thread, bootstrapping on main thread: " << GetLastErrorAsString() << std::endl;
+        setupExecutableHook(bootstrapperModuleHandle);
+    } else {
+        WaitForSingleObject(bootstrapFinishedEvent, INFINITE);
+        CloseHandle(threadHandle);
+    }
+    Logging::logFile << "Bootstrapping finished, resuming game entry point" << std::endl;
+    return gameEntryPoint(processEnvironmentBlock);
+}
+
+bool hookGameEntryPoint(HMODULE selfModuleHandle, bool bStaticLoad) {
+    Logging::initializeLogging();
+    Config::initializeConfig();
+    if (!Config::bootstrapOnDedicatedThread) {
+        return false;
+    }
+    if (!bStaticLoad) {
+        Logging::logFile << "[WARNING] Bootstrapper is loaded dynamically, game entry point has already been called. Bootstrapping from DllMain" << std::endl;
+        return false;
+    }
+    HMODULE gameModule = GetModuleHandleA(GAME_MODULE_NAME);
+    if (gameModule == nullptr) {
+        return false;
+    }
+    auto dosHeader = (PIMAGE_DOS_HEADER) gameModule;
+    auto ntHeader = (PIMAGE_NT_HEADERS) ((uint8_t*) gameModule + dosHeader->e_lfanew);
+    bootstrapperModuleHandle = selfModuleHandle;
+    bootstrapFinishedEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    gameEntryPoint = (GameEntryPointFunc) ((uint8_t*) gameModule + ntHeader->OptionalHeader.AddressOfEntryPoint);
+    memcpy(originalEntryPointBytes, (void*) gameEntryPoint, ENTRY_POINT_PATCH_SIZE);
+
+    uint8_t patchBytes[ENTRY_POINT_PATCH_SIZE] = {0xFF, 0x25, 0x00, 0x00, 0x00, 0x00};
+    const uint64_t hookAddress = (uint64_t) &gameEntryPointHook;
+    memcpy(patchBytes + 6, &hookAddress, sizeof(hookAddress));
+    writeEntryPointBytes(patchBytes);
+    Logging::logFile << "Hooked game entry point at " << (void*) gameEntryPoint << std::endl;
+    return true;
+}
+
 void setupExecutableHook(HMODULE selfModuleHandle) {
     //fast route to exit before locking on mutex
     if (hookAlreadySetup) return;
@@ -192,6 +521,7 @@ void setupExecutableHook(HMODULE selfModuleHandle) {
     //initialize systems, load symbols, call bootstrapper modules
     Logging::initializeLogging();
     Logging::logFile << "Setting up hooking" << std::endl;
+    Config::initializeConfig();
 
     path rootGameDirectory = resolveGameRootDir();
     path bootstrapperDirectory = path(getModuleFileName(selfModuleHandle)).parent_path();
@@ -203,17 +533,17 @@ void setupExecutableHook(HMODULE selfModuleHandle) {
         Logging::logFile << "Failed to find primary game module with name: " << GAME_MODULE_NAME << std::endl;
         exit(1);
     }
-    path diaDllPath = bootstrapperDirectory / "msdia140.dll";
-    HMODULE diaDllHandle = LoadLibraryW(diaDllPath.wstring().c_str());
-    if (diaDllHandle == nullptr) {
-        Logging::logFile << "Failed to load DIA SDK implementation DLL." << std::endl;
-        Logging::logFile << "Expected to find it at: " << diaDllPath.string() << std::endl;
-        Logging::logFile << "Make sure it is here and restart. Exiting now." << std::endl;
-        exit(1);
+    if (symbolResolver == nullptr) {
+        symbolResolver = createSymbolResolver(gameModule, selfModuleHandle);
     }
-    //TODO strict mode where missing symbols result in aborting?
-    auto* resolver = new SymbolResolver(gameModule, diaDllHandle, false);
-    dllLoader = new DllLoader(resolver);
+    InitializeVirtualTableSizing(gameModule);
+    //threads can't start while DllMain holds the loader lock, so modules are resolved on the calling thread only then
+    uint32_t importWorkerThreadCount = 0;
+    if (bootstrapOutsideLoaderLock) {
+        const uint32_t hardwareThreadCount = std::thread::hardware_concurrency();
+        importWorkerThreadCount = hardwareThreadCount > MAX_IMPORT_WORKER_THREADS ? MAX_IMPORT_WORKER_THREADS : (hardwareThreadCount > 1 ? hardwareThreadCount - 1 : 0);
+    }
+    dllLoader = new DllLoader(symbolResolver, bootstrapperDirectory / "import-cache", importWorkerThreadCount);
 
     Logging::logFile << "Discovering loader modules..." << std::endl;
     std::map<std::string, HMODULE> discoveredMods;
@@ -221,6 +551,26 @@ void setupExecutableHook(HMODULE selfModuleHandle) {
 
     Logging::logFile << "Bootstrapping loader modules..." << std::endl;
     bootstrapLoaderMods(discoveredMods, rootGameDirectory.wstring());
+    const uint32_t builtVirtualTableCount = BuildRegisteredVirtualTables();
+    Logging::logFile << "Built " << builtVirtualTableCount << " patched virtual tables for registered constructor hooks" << std::endl;
+    const uint32_t specializedThunkCount = specializeConstructorHookThunks();
+    Logging::logFile << "Specialized " << specializedThunkCount << " constructor hook thunks" << std::endl;
 
+    symbolResolver->FlushWarmUpLog();
+    if (Config::releaseDiaAfterBootstrap) {
+        logProcessMemoryUsage("before releasing DIA");
+        symbolResolver->ReleaseDiaSession();
+        logProcessMemoryUsage("after releasing DIA");
+    }
+
+    logCacheCounters("Resolved symbol", symbolResolver->GetResolvedSymbolCacheCounters());
+    logCacheCounters("Symbol digest", symbolResolver->GetSymbolDigestCacheCounters());
+    logCacheCounters("Member function digest", GetMemberFunctionDigestCacheCounters());
+    const CodeArena& codeArena = symbolResolver->destructorGenerator->GetCodeArena();
+    Logging::logFile << "Generated " << codeArena.GetFunctionCount() << " functions: " << codeArena.GetUsedSize() << " bytes used of ";
+    Logging::logFile << codeArena.GetCommittedSize() << " bytes committed" << std::endl;
+    if (codeArena.GetFarBlockCount() != 0) {
+        Logging::logFile << "[WARNING] " << codeArena.GetFarBlockCount() << " generated code blocks are out of rel32 range of the game image" << std::endl;
+    }
     Logging::logFile << "Successfully performed bootstrapping." << std::endl;
 }
@@ -6,4 +6,21 @@
 
 void setupExecutableHook(HMODULE selfModule);
 
+/**
+ * Creates symbol resolver and starts loading symbol index on the background thread,
+ * so it is done in parallel with the engine initialization. Called from DLL_PROCESS_ATTACH
+ * @return identifier of the started thread, or 0 if it wasn't started
+ */
+DWORD startSymbolWarmup(HMODULE selfModule);
+
+/**
+ * Patches entry point of the game executable to bootstrap loader modules before it runs
+ * Bootstrapping is performed on a dedicated thread while the game's main thread waits for it,
+ * so it doesn't hold the loader lock like setupExecutableHook called from DllMain does
+ * Only works if the bootstrapper is loaded statically, before the entry point is called
+ * @param bStaticLoad whether bootstrapper is loaded as a static dependency of the game
+ * @return true if entry point was hooked, false if bootstrapping should be done from DllMain
+ */
+bool hookGameEntryPoint(HMODULE selfModule, bool bStaticLoad);
+
 #endif //XINPUT1_3_CONTROLLER_H
@@ -20,6 +20,16 @@ typedef void(*FlushDebugSymbolsFunc)();
  */
 typedef struct SymbolDigestInfo(*DigestGameSymbolFunc)(const wchar_t* symbolName);
 
+/**
+ * Digests multiple symbols in one call, see DigestGameSymbolFunc for the meaning of the results
+ * Symbol names are written into the caller-provided string arena instead of being allocated separately,
+ * so they don't need to be freed. Names that don't fit into the arena are left null
+ * @param stringArena buffer receiving null-terminated symbol names, can be null to only compute required size
+ * @param stringArenaSize size of the arena in characters
+ * @return number of characters required to store all symbol names, including null terminators
+ */
+typedef unsigned long long(*DigestGameSymbolsFunc)(const wchar_t* const* symbolNames, unsigned long long symbolCount, struct SymbolDigestInfo* outDigestInfos, wchar_t* stringArena, unsigned long long stringArenaSize);
+
 /**
  * @return list of symbol root directories joined by ';' symbol;
  * @note Memory will be allocated by using provided malloc and **should be freed manually by the caller**
@@ -40,6 +50,23 @@ typedef struct ConstructorHookThunk(*CreateConstructorHookThunkFunc)();
  */
 typedef bool(*AddConstructorHookFunc)(struct ConstructorHookThunk ConstructorThunk, struct VirtualFunctionHookInfo HookInfo);
 
+/**
+ * Registers original virtual table the hooked constructor installs into the object, e.g. digested ??_7Class@@6B@ symbol
+ * Patched table for it is built once all modules are bootstrapped, instead of on the first constructor call
+ * @param virtualTableOffset offset of the virtual table pointer in the object, 0 for the primary virtual table
+ * @return false if the thunk is invalid, or the table is not in the read-only data of the game image
+ */
+typedef bool(*RegisterConstructorVirtualTableFunc)(struct ConstructorHookThunk ConstructorThunk, unsigned int virtualTableOffset, void* originalVirtualTable);
+
+/**
+ * Hooks virtual functions by overriding slots of the original virtual table, e.g. digested ??_7Class@@6B@ symbol
+ * Unlike constructor hooks, it applies to all objects using the table, including already constructed ones,
+ * and costs nothing per object. Functions of derived classes which don't override hooked ones are not affected,
+ * since they have their own tables
+ * @return false if any of the functions is not virtual or table is invalid, nothing is hooked then
+ */
+typedef bool(*PatchVirtualTableFunc)(void* virtualTable, const struct VirtualFunctionHookInfo* hookInfos, unsigned long long hookCount);
+
 typedef struct MemberFunctionPointerDigestInfo(*DigestMemberFunctionPointerFunc)(struct MemberFunctionPointerInfo Info);
 
 typedef void(*FreeStringFunc)(wchar_t* String);
@@ -82,6 +109,10 @@ struct VirtualFunctionHookInfo {
     void** OutOriginalFunctionPtr;
 };
 
+/**
+ * Symbol resolution and digest functions can be called from any thread without external locking
+ * Fields are only ever appended, check version before using fields added after 2.0.11
+ */
 struct BootstrapAccessors {
     const wchar_t* gameRootDirectory;
     LoadModuleFunc LoadModule;
@@ -95,8 +126,22 @@ struct BootstrapAccessors {
     CreateConstructorHookThunkFunc CreateConstructorHookThunk;
     AddConstructorHookFunc AddConstructorHook;
     DigestMemberFunctionPointerFunc DigestMemberFunctionPointer;
+    //added in 2.1.0
+    DigestGameSymbolsFunc DigestGameSymbols;
+    //added in 2.1.0
+    RegisterConstructorVirtualTableFunc RegisterConstructorVirtualTable;
+    //added in 2.1.0
+    PatchVirtualTableFunc PatchVirtualTable;
 };
 
 typedef void(*BootstrapModuleFunc)(BootstrapAccessors& accessors);
 
+/**
+ * Optional function exported by the loader module as GetBootstrapDependencies
+ * Loader modules imported by the module are always bootstrapped before it, even if they are not listed
+ * @return file names of the loader modules which should be bootstrapped before this one, separated by ';'
+ */
+#define BOOTSTRAP_DEPENDENCY_SEPARATOR ';'
+typedef const char*(*GetBootstrapDependenciesFunc)();
+
 #endif //XINPUT1_3_EXPORTS_H
@@ -1,10 +1,22 @@
 #include "logging.h"
 
 namespace Logging {
-    std::ofstream logFile;
+    LogStream logFile;
+    static thread_local std::ostream* threadLogBuffer = nullptr;
+
+    std::ostream& LogStream::stream() {
+        return threadLogBuffer != nullptr ? *threadLogBuffer : file;
+    }
 
     void initializeLogging() {
-        logFile.open("pre-launch-debug.log", std::ifstream::trunc | std::ifstream::out);
+        if (logFile.file.is_open()) {
+            return;
+        }
+        logFile.file.open("pre-launch-debug.log", std::ifstream::trunc | std::ifstream::out);
         logFile << "Log System Initialized!" << std::endl;
     }
+
+    void setThreadLogBuffer(std::ostream* buffer) {
+        threadLogBuffer = buffer;
+    }
 }
@@ -1,13 +1,36 @@
-
 #ifndef XINPUT1_3_LOGGING_H
 #define XINPUT1_3_LOGGING_H
 
 #include <fstream>
 
 namespace Logging {
-    extern std::ofstream logFile;
+    /** Writes into the log file, or into the buffer of the current thread if it has one set */
+    class LogStream {
+    public:
+        std::ofstream file;
+
+        template<typename T>
+        LogStream& operator<<(const T& value) {
+            stream() << value;
+            return *this;
+        }
+        LogStream& operator<<(std::ostream& (*manipulator)(std::ostream&)) {
+            stream() << manipulator;
+            return *this;
+        }
+        operator std::ostream&() { return stream(); }
+        std::ostream& stream();
+    };
+
+    extern LogStream logFile;
 
     void initializeLogging();
+
+    /**
+     * Redirects messages logged by the current thread into the buffer, so threads running concurrently
+     * don't write into the log file at the same time. Passing nullptr makes thread log into the file again
+     */
+    void setThreadLogBuffer(std::ostream* buffer);
 }
 
 #endif //XINPUT1_3_LOGGING_H
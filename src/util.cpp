@@ -34,4 +34,25 @@ std::string GetLastErrorAsString() {
     LocalFree(messageBuffer);
 
     return message;
-}
\ No newline at end of file
+}
+
+std::string WideToUtf8(const wchar_t* String) {
+    int ResultLength = WideCharToMultiByte(CP_UTF8, 0, String, -1, nullptr, 0, nullptr, nullptr);
+    if (ResultLength <= 1) {
+        return std::string();
+    }
+    //returned length includes null terminator, which std::string takes care of itself
+    std::string Result(ResultLength - 1, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, String, -1, Result.data(), ResultLength, nullptr, nullptr);
+    return Result;
+}
+
+std::wstring Utf8ToWide(const char* String, size_t Length) {
+    if (Length == 0) {
+        return std::wstring();
+    }
+    int ResultLength = MultiByteToWideChar(CP_UTF8, 0, String, (int) Length, nullptr, 0);
+    std::wstring Result(ResultLength, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, String, (int) Length, Result.data(), ResultLength);
+    return Result;
+}
@@ -9,4 +9,8 @@ std::wstring getModuleFileName(HMODULE moduleHandle);
 
 std::string GetLastErrorAsString();
 
+std::string WideToUtf8(const wchar_t* String);
+
+std::wstring Utf8ToWide(const char* String, size_t Length);
+
 #endif //XINPUT1_3_UTIL_H
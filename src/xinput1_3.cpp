@@ -9,6 +9,7 @@ extern "C" UINT_PTR mProcs[12] = {0};
 void load_original_dll();
 
 static bool hooked = false;
+static DWORD symbolWarmupThreadId = 0;
 
 LPCSTR mImportNames[] = {"DllMain", "XInputEnable", "XInputGetBatteryInformation", "XInputGetCapabilities", "XInputGetDSoundAudioDeviceGuids", "XInputGetKeystroke", "XInputGetState", "XInputSetState", (LPCSTR)100, (LPCSTR)101, (LPCSTR)102, (LPCSTR)103};
 BOOL WINAPI DllMain( HMODULE hinstDLL, DWORD fdwReason, LPVOID lpvReserved ) {
@@ -18,6 +19,9 @@ BOOL WINAPI DllMain( HMODULE hinstDLL, DWORD fdwReason, LPVOID lpvReserved ) {
 		for (int i = 0; i < 12; i++) {
 			mProcs[i] = (UINT_PTR)GetProcAddress(mHinstDLL, mImportNames[i]);
 		}
+		symbolWarmupThreadId = startSymbolWarmup(hinstDLL);
+		//non-null reserved parameter means we are loaded statically, before the game entry point is called
+		hooked = hookGameEntryPoint(hinstDLL, lpvReserved != nullptr);
 	}
 	else if (fdwReason == DLL_PROCESS_DETACH) {
 		FreeLibrary(mHinstDLL);
@@ -26,7 +30,8 @@ BOOL WINAPI DllMain( HMODULE hinstDLL, DWORD fdwReason, LPVOID lpvReserved ) {
 	if (hooked) {
 		return ( TRUE );
 	}
-	if ( fdwReason == DLL_THREAD_ATTACH) {
+	//warm-up thread attaching is not the engine starting up, don't bootstrap on it
+	if ( fdwReason == DLL_THREAD_ATTACH && GetCurrentThreadId() != symbolWarmupThreadId) {
 		hooked = true;
 		setupExecutableHook(hinstDLL);
 	}
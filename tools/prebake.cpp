@@ -0,0 +1,145 @@
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <filesystem>
+#include "ImportBindingCache.h"
+#include "MappedFile.h"
+#include "PdbReader.h"
+#include "PeImage.h"
+#include "SymbolIndex.h"
+
+/**
+ * Builds symbol index and import binding caches ahead of time, without running the game
+ * Output directory has the same layout as the bootstrapper directory, so its contents can be
+ * copied next to the bootstrapper DLL and the game will start with warm caches
+ */
+
+static void PrintUsage() {
+    std::cerr << "Usage: bootstrapper_prebake <game executable> <game pdb> <loaders directory> <output directory>" << std::endl;
+}
+
+static std::string ToLowerAscii(std::string_view String) {
+    std::string Result(String);
+    for (char& Character : Result) {
+        if (Character >= 'A' && Character <= 'Z') {
+            Character = (char) (Character - 'A' + 'a');
+        }
+    }
+    return Result;
+}
+
+/** Records bindings the same way DllLoader does when it resolves game symbol imports of the module */
+static bool BuildModuleBindings(const PeImage& Image, const SymbolIndex& Index, const std::unordered_set<std::string>& ModuleNames, ImportBindingCacheBuilder& CacheBuilder) {
+    return Image.ForEachImportDescriptor([&](const PeImportDescriptor& Descriptor) {
+        //other loader modules are mapped before imports are resolved, so they are never resolved from the game
+        if (ModuleNames.count(ToLowerAscii(Descriptor.LibraryName)) != 0) {
+            return true;
+        }
+        //imports of system libraries are recorded too, loader ignores bindings of libraries it can find
+        return Image.ForEachImport(Descriptor, [&](const PeImport& Import) {
+            if (Import.bByOrdinal) {
+                return true;
+            }
+            const SymbolIndexEntry* IndexEntry = Index.FindSymbol(Import.Name.data(), Import.Name.size());
+            if (IndexEntry != nullptr && (IndexEntry->Flags & SymbolFlag_HasAddress)) {
+                CacheBuilder.AddBinding(Import.AddressSlotRva, ImportBinding_GameImage, IndexEntry->RelativeVirtualAddress);
+            } else {
+                //provided or unresolved symbols, they are resolved again in runtime
+                CacheBuilder.AddBinding(Import.AddressSlotRva, ImportBinding_Resolve, 0);
+            }
+            return true;
+        });
+    });
+}
+
+int main(int ArgumentCount, char** Arguments) {
+    if (ArgumentCount != 5) {
+        PrintUsage();
+        return 1;
+    }
+    const std::filesystem::path ExecutablePath = Arguments[1];
+    const std::filesystem::path PdbPath = Arguments[2];
+    const std::filesystem::path LoadersDirectory = Arguments[3];
+    const std::filesystem::path OutputDirectory = Arguments[4];
+
+    MappedFile ExecutableFile;
+    PeImage ExecutableImage;
+    PeCodeViewInfo CodeViewInfo{};
+    if (!ExecutableFile.Open(ExecutablePath) || !ExecutableImage.Open(ExecutableFile.GetData(), ExecutableFile.GetSize(), PeImageLayout::File)) {
+        std::cerr << "Failed to read game executable " << ExecutablePath << std::endl;
+        return 1;
+    }
+    if (!ExecutableImage.GetCodeViewInfo(CodeViewInfo)) {
+        std::cerr << "Game executable doesn't reference a PDB, caches can't be validated in runtime" << std::endl;
+        return 1;
+    }
+    PdbSignature GameSignature{};
+    memcpy(GameSignature.Guid, CodeViewInfo.Guid, sizeof(GameSignature.Guid));
+    GameSignature.Age = CodeViewInfo.Age;
+
+    PdbReader Reader;
+    if (!Reader.Open(PdbPath)) {
+        std::cerr << "Failed to read game PDB " << PdbPath << std::endl;
+        return 1;
+    }
+    if (Reader.GetSignature() != GameSignature) {
+        std::cerr << "PDB " << PdbPath << " doesn't match the game executable" << std::endl;
+        return 1;
+    }
+    SymbolIndexBuilder IndexBuilder;
+    AddPdbSymbolsToIndex(Reader, IndexBuilder);
+    std::vector<uint8_t> IndexData = IndexBuilder.Serialize(GameSignature);
+
+    std::error_code ErrorCode;
+    std::filesystem::create_directories(OutputDirectory / "import-cache", ErrorCode);
+    if (ErrorCode || !WriteCacheFile(OutputDirectory / "symbol-index.bin", IndexData)) {
+        std::cerr << "Failed to write symbol index into " << OutputDirectory << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote symbol index with " << IndexBuilder.GetSymbolCount() << " symbols" << std::endl;
+
+    SymbolIndex Index;
+    if (!Index.OpenBuffer(std::move(IndexData))) {
+        std::cerr << "Built symbol index is malformed" << std::endl;
+        return 1;
+    }
+
+    //same module discovery rules as the bootstrapper
+    std::vector<std::filesystem::path> ModulePaths;
+    std::unordered_set<std::string> ModuleNames;
+    for (const auto& File : std::filesystem::directory_iterator(LoadersDirectory, ErrorCode)) {
+        if (File.is_regular_file() && File.path().extension() == ".dll") {
+            ModulePaths.push_back(File.path());
+            ModuleNames.insert(ToLowerAscii(File.path().filename().string()));
+        }
+    }
+    if (ErrorCode) {
+        std::cerr << "Failed to list loaders directory " << LoadersDirectory << std::endl;
+        return 1;
+    }
+
+    int ExitCode = 0;
+    for (const std::filesystem::path& ModulePath : ModulePaths) {
+        MappedFile ModuleFile;
+        PeImage ModuleImage;
+        ImportBindingCacheBuilder CacheBuilder;
+        if (!ModuleFile.Open(ModulePath) || !ModuleImage.Open(ModuleFile.GetData(), ModuleFile.GetSize(), PeImageLayout::File) ||
+            !BuildModuleBindings(ModuleImage, Index, ModuleNames, CacheBuilder)) {
+            std::cerr << "Skipping malformed module " << ModulePath.filename() << std::endl;
+            ExitCode = 1;
+            continue;
+        }
+        const uint64_t ModuleHash = HashModuleContents(ModuleFile.GetData(), ModuleFile.GetSize());
+        std::filesystem::path CacheFilePath = OutputDirectory / "import-cache" / ModulePath.filename();
+        CacheFilePath += ".bin";
+        if (!WriteCacheFile(CacheFilePath, CacheBuilder.Serialize(GameSignature, ModuleHash))) {
+            std::cerr << "Failed to write import binding cache " << CacheFilePath << std::endl;
+            ExitCode = 1;
+            continue;
+        }
+        std::cout << "Wrote import binding cache of " << ModulePath.filename() << " with " << CacheBuilder.GetBindingCount() << " bindings" << std::endl;
+    }
+    return ExitCode;
+}